@@ -0,0 +1,156 @@
+#include "AlignStats.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ALIGNSTATS_X86 1
+#include <immintrin.h>
+#endif
+
+// Both kernels turn a block of columns into bit masks, one bit per column:
+// q and h mark gaps in either sequence, eq marks equal residues. A gap run
+// opens at every gap bit whose predecessor is not a gap; the predecessor of
+// a block's first column is carried over from the previous block.
+static void count_block(AlignStats& stats, unsigned long long q, unsigned long long h,
+                        unsigned long long eq, unsigned long long& q_prev,
+                        unsigned long long& h_prev, int width)
+{
+    unsigned long long q_open = q & ~((q << 1) | q_prev);
+    unsigned long long h_open = h & ~((h << 1) | h_prev);
+    stats.query_gaps += __builtin_popcountll(q);
+    stats.hit_gaps += __builtin_popcountll(h);
+    stats.gap_opens += __builtin_popcountll(q_open) + __builtin_popcountll(h_open);
+    stats.matches += __builtin_popcountll(eq & ~(q | h));
+    stats.mismatches += __builtin_popcountll(~(eq | q | h) & ((1ULL << width) - 1));
+    q_prev = (q >> (width - 1)) & 1;
+    h_prev = (h >> (width - 1)) & 1;
+}
+
+static inline char fold(char c)
+{
+    return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+// count columns [i, n) one at a time, continuing the gap runs of column i-1
+static void count_tail(AlignStats& stats, const char* qseq, const char* hseq,
+                       size_t i, size_t n)
+{
+    bool q_prev = i > 0 && qseq[i - 1] == '-';
+    bool h_prev = i > 0 && hseq[i - 1] == '-';
+    for (; i < n; ++i) {
+        bool q = qseq[i] == '-', h = hseq[i] == '-';
+        stats.query_gaps += q;
+        stats.hit_gaps += h;
+        stats.gap_opens += (q && !q_prev) + (h && !h_prev);
+        if (!q && !h) {
+            if (fold(qseq[i]) == fold(hseq[i])) {
+                ++stats.matches;
+            } else {
+                ++stats.mismatches;
+            }
+        }
+        q_prev = q;
+        h_prev = h;
+    }
+}
+
+AlignStats align_stats_scalar(const char* qseq, const char* hseq, size_t n)
+{
+    AlignStats stats;
+    count_tail(stats, qseq, hseq, 0, n);
+    return stats;
+}
+
+#ifdef ALIGNSTATS_X86
+
+// Vector kernels upper-case 'a'..'z' by subtracting 0x20 where the signed
+// compares put a byte between the bounds; bytes from 0x80 compare negative
+// and are left alone.
+
+__attribute__((target("avx2,popcnt")))
+static AlignStats align_stats_avx2(const char* qseq, const char* hseq, size_t n)
+{
+    AlignStats stats;
+    const __m256i gap = _mm256_set1_epi8('-');
+    const __m256i below_a = _mm256_set1_epi8('a' - 1);
+    const __m256i above_z = _mm256_set1_epi8('z');
+    const __m256i diff = _mm256_set1_epi8('a' - 'A');
+    unsigned long long q_prev = 0, h_prev = 0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(qseq + i));
+        __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hseq + i));
+        __m256i q_lower = _mm256_andnot_si256(_mm256_cmpgt_epi8(q, above_z),
+                                              _mm256_cmpgt_epi8(q, below_a));
+        __m256i h_lower = _mm256_andnot_si256(_mm256_cmpgt_epi8(h, above_z),
+                                              _mm256_cmpgt_epi8(h, below_a));
+        q = _mm256_sub_epi8(q, _mm256_and_si256(q_lower, diff));
+        h = _mm256_sub_epi8(h, _mm256_and_si256(h_lower, diff));
+        unsigned q_gaps = _mm256_movemask_epi8(_mm256_cmpeq_epi8(q, gap));
+        unsigned h_gaps = _mm256_movemask_epi8(_mm256_cmpeq_epi8(h, gap));
+        unsigned eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(q, h));
+        count_block(stats, q_gaps, h_gaps, eq, q_prev, h_prev, 32);
+    }
+    count_tail(stats, qseq, hseq, i, n);
+    return stats;
+}
+
+__attribute__((target("sse4.2,popcnt")))
+static AlignStats align_stats_sse42(const char* qseq, const char* hseq, size_t n)
+{
+    AlignStats stats;
+    const __m128i gap = _mm_set1_epi8('-');
+    const __m128i below_a = _mm_set1_epi8('a' - 1);
+    const __m128i above_z = _mm_set1_epi8('z');
+    const __m128i diff = _mm_set1_epi8('a' - 'A');
+    unsigned long long q_prev = 0, h_prev = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i*>(qseq + i));
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hseq + i));
+        __m128i q_lower = _mm_andnot_si128(_mm_cmpgt_epi8(q, above_z),
+                                           _mm_cmpgt_epi8(q, below_a));
+        __m128i h_lower = _mm_andnot_si128(_mm_cmpgt_epi8(h, above_z),
+                                           _mm_cmpgt_epi8(h, below_a));
+        q = _mm_sub_epi8(q, _mm_and_si128(q_lower, diff));
+        h = _mm_sub_epi8(h, _mm_and_si128(h_lower, diff));
+        unsigned q_gaps = _mm_movemask_epi8(_mm_cmpeq_epi8(q, gap));
+        unsigned h_gaps = _mm_movemask_epi8(_mm_cmpeq_epi8(h, gap));
+        unsigned eq = _mm_movemask_epi8(_mm_cmpeq_epi8(q, h));
+        count_block(stats, q_gaps, h_gaps, eq, q_prev, h_prev, 16);
+    }
+    count_tail(stats, qseq, hseq, i, n);
+    return stats;
+}
+
+#endif // ALIGNSTATS_X86
+
+std::vector<KernelChoice> align_stats_kernels()
+{
+    std::vector<KernelChoice> kernels;
+#ifdef ALIGNSTATS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({align_stats_avx2, "avx2"});
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        kernels.push_back({align_stats_sse42, "sse4.2"});
+    }
+#endif
+    kernels.push_back({align_stats_scalar, "scalar"});
+    return kernels;
+}
+
+static const KernelChoice& kernel()
+{
+    static const KernelChoice choice = align_stats_kernels().front();
+    return choice;
+}
+
+AlignStats align_stats(const char* qseq, const char* hseq, size_t n)
+{
+    return kernel().kernel(qseq, hseq, n);
+}
+
+const char* align_stats_kernel()
+{
+    return kernel().name;
+}
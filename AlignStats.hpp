@@ -0,0 +1,41 @@
+#ifndef ALIGNSTATS_HPP
+#define ALIGNSTATS_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Column counts of a pairwise alignment given as two equally long gapped
+// strings, as in Hsp_qseq and Hsp_hseq. Residues are compared ignoring
+// case, so masked (lower case) regions still count as matches.
+struct AlignStats
+{
+    int matches = 0;        // columns with equal residues
+    int mismatches = 0;     // columns with different residues
+    int query_gaps = 0;     // '-' in the query
+    int hit_gaps = 0;       // '-' in the subject
+    int gap_opens = 0;      // runs of '-' in either sequence
+};
+
+// Count the first n columns of qseq and hseq. Uses AVX2 or SSE4.2 when the
+// CPU supports them, the portable loop otherwise.
+AlignStats align_stats(const char* qseq, const char* hseq, size_t n);
+
+// The portable loop on its own, as a reference for the vector kernels
+AlignStats align_stats_scalar(const char* qseq, const char* hseq, size_t n);
+
+// Name of the kernel align_stats uses: "avx2", "sse4.2", or "scalar"
+const char* align_stats_kernel();
+
+typedef AlignStats (*AlignStatsKernel)(const char*, const char*, size_t);
+
+struct KernelChoice
+{
+    AlignStatsKernel    kernel;
+    const char*         name;
+};
+
+// Every kernel the CPU supports, the one align_stats uses first and the
+// scalar loop last; for testing them against each other
+std::vector<KernelChoice> align_stats_kernels();
+
+#endif // ALIGNSTATS_HPP
@@ -0,0 +1,303 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "AlignmentWriter.hpp"
+
+// the buffer is written once it holds this much, also within a batch
+static const size_t WRITE_SIZE = 4 << 20;
+
+static inline void append_int(std::string& out, long long value)
+{
+    char text[24];
+    int n = snprintf(text, sizeof(text), "%lld", value);
+    out.append(text, n);
+}
+
+static inline void append_float(std::string& out, const char* format, double value)
+{
+    char text[32];
+    int n = snprintf(text, sizeof(text), format, value);
+    out.append(text, n);
+}
+
+// the read name: the first word of the query definition, as SAM names
+// must not contain spaces
+static inline void append_name(std::string& out, const BlastQuery& query)
+{
+    const std::string& def = query.getQueryDef();
+    size_t space = def.find_first_of(" \t");
+    if (def.empty() || space == 0) {
+        out += "Query_";
+        append_int(out, query.getQueryNum());
+    } else {
+        out.append(def, 0, space);
+    }
+}
+
+// nucleotide codes, with IUPAC ambiguity codes, as a blastn Hsp_qseq may
+// hold them
+static const char NUCLEOTIDES[] = "ACGTUNRYKMSWBDHVacgtunrykmswbdhv-";
+
+static inline char complement(char c)
+{
+    switch (c) {
+    case 'A': return 'T';
+    case 'C': return 'G';
+    case 'G': return 'C';
+    case 'T': case 'U': return 'A';
+    case 'R': return 'Y';
+    case 'Y': return 'R';
+    case 'K': return 'M';
+    case 'M': return 'K';
+    case 'B': return 'V';
+    case 'V': return 'B';
+    case 'D': return 'H';
+    case 'H': return 'D';
+    case 'a': return 't';
+    case 'c': return 'g';
+    case 'g': return 'c';
+    case 't': case 'u': return 'a';
+    case 'r': return 'y';
+    case 'y': return 'r';
+    case 'k': return 'm';
+    case 'm': return 'k';
+    case 'b': return 'v';
+    case 'v': return 'b';
+    case 'd': return 'h';
+    case 'h': return 'd';
+    default: return c;
+    }
+}
+
+// true if hsp aligns nucleotides on both sides, as blastn does, rather
+// than amino acids translated from them: both frames are strands and qseq
+// holds only nucleotide codes (tblastx reports frames of 1 and -1 too)
+static bool nucleotide(const Hsp& hsp)
+{
+    return std::abs(hsp.getQueryFrame()) == 1 && std::abs(hsp.getHitFrame()) == 1 &&
+           hsp.getQSeq().find_first_not_of(NUCLEOTIDES) == std::string::npos;
+}
+
+// the query residues of qseq without gaps, reversed if reverse and then
+// also complemented if complemented
+static void append_read(std::string& out, const std::string& qseq, bool reverse, bool complemented)
+{
+    if (reverse) {
+        for (size_t i = qseq.size(); i-- > 0; ) {
+            if (qseq[i] != '-') {
+                out += complemented ? complement(qseq[i]) : qseq[i];
+            }
+        }
+    } else {
+        for (char c : qseq) {
+            if (c != '-') {
+                out += c;
+            }
+        }
+    }
+}
+
+static inline void append_ops(std::string& out, const std::vector<CigarOp>& ops)
+{
+    for (auto& op : ops) {
+        append_int(out, op.len);
+        out += op.op;
+    }
+}
+
+AlignmentWriter::AlignmentWriter(const std::string& path, AlignmentFormat format)
+    : path_(path),
+      format_(format),
+      fd_(path == "-" ? STDOUT_FILENO : open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644))
+{
+    if (fd_ < 0) {
+        throw std::logic_error("Cannot create '" + path + "': " + strerror(errno));
+    }
+    out_.reserve(WRITE_SIZE + (64 << 10));
+}
+
+AlignmentWriter::~AlignmentWriter()
+{
+    if (fd_ >= 0 && fd_ != STDOUT_FILENO) {
+        close(fd_);
+    }
+}
+
+void AlignmentWriter::onStart(BlastCounters& counters, SubjectInterner& subjects)
+{
+    if (format_ == AlignmentFormat::Sam) {
+        // subjects are only known once they are hit, so there are no @SQ
+        // lines; samtools adds them from the reference (view -t ref.fai)
+        out_ += "@HD\tVN:1.6\tSO:unsorted\n@PG\tID:bigBlastParser\tPN:bigBlastParser\n";
+    }
+}
+
+void AlignmentWriter::onBatch(std::vector<BlastQuery>& batch)
+{
+    for (auto& query : batch) {
+        // BLAST reports the best hsp first
+        bool primary = true;
+        for (auto& hit : query.getHit()) {
+            for (auto& hsp : hit.getHsp()) {
+                if (format_ == AlignmentFormat::Sam) {
+                    writeSam(query, hit, hsp, primary);
+                } else {
+                    writePaf(query, hit, hsp, primary);
+                }
+                primary = false;
+                ++written_;
+                if (out_.size() >= WRITE_SIZE) {
+                    flush();
+                }
+            }
+        }
+    }
+    flush();
+    // progress must not end up in the alignments written to stdout
+    (fd_ == STDOUT_FILENO ? std::cerr : cout) << "Processed " << written_ << " hsps." << endl;
+}
+
+void AlignmentWriter::onFinish(const BlastCounters& counters)
+{
+    flush();
+    if (fd_ != STDOUT_FILENO && close(fd_) != 0) {
+        fd_ = -1;
+        throw std::logic_error("Cannot write '" + path_ + "': " + strerror(errno));
+    }
+    fd_ = -1;
+}
+
+void AlignmentWriter::alignment(const Hsp& hsp, bool reverse)
+{
+    const std::string& qseq = hsp.getQSeq();
+    const std::string& hseq = hsp.getHSeq();
+    if (qseq.empty() || qseq.size() != hseq.size()) {
+        ops_.clear();
+        return;
+    }
+    cigar_ops(qseq.data(), hseq.data(), qseq.size(), ops_);
+    if (reverse) {
+        std::reverse(ops_.begin(), ops_.end());
+    }
+}
+
+void AlignmentWriter::writeSam(const BlastQuery& query, const BlastHit& hit, const Hsp& hsp,
+                               bool primary)
+{
+    // the alignment runs backwards on the subject's plus strand if the hsp
+    // is on its minus strand; the read is reverse if the strands differ.
+    // Amino acids have no complement, so a translated read is only reversed.
+    bool backwards = hsp.getHitFrame() < 0;
+    bool reverse = (hsp.getQueryFrame() < 0) != backwards;
+    alignment(hsp, backwards);
+    int query_start = std::min(hsp.getQueryFrom(), hsp.getQueryTo());
+    int query_end = std::max(hsp.getQueryFrom(), hsp.getQueryTo());
+    int left_clip = query_start - 1;
+    int right_clip = query.getQueryLen() - query_end;
+    if (reverse) {
+        std::swap(left_clip, right_clip);
+    }
+
+    append_name(out_, query);
+    out_ += '\t';
+    append_int(out_, (reverse ? 16 : 0) | (primary ? 0 : 256));
+    out_ += '\t';
+    out_ += hit.getHitAccession();
+    out_ += '\t';
+    append_int(out_, std::min(hsp.getHitFrom(), hsp.getHitTo()));
+    out_ += "\t255\t";
+    if (ops_.empty()) {
+        out_ += '*';
+    } else {
+        if (left_clip > 0) {
+            append_int(out_, left_clip);
+            out_ += 'H';
+        }
+        append_ops(out_, ops_);
+        if (right_clip > 0) {
+            append_int(out_, right_clip);
+            out_ += 'H';
+        }
+    }
+    out_ += "\t*\t0\t0\t";
+    if (ops_.empty()) {
+        out_ += '*';
+    } else {
+        append_read(out_, hsp.getQSeq(), backwards, backwards && nucleotide(hsp));
+    }
+    out_ += "\t*\tAS:i:";
+    append_int(out_, hsp.getScore());
+    out_ += "\tNM:i:";
+    append_int(out_, hsp.getMismatches() + hsp.getGaps());
+    out_ += "\tZB:f:";
+    append_float(out_, "%.1f", hsp.getBitScore());
+    out_ += "\tZE:Z:";
+    append_float(out_, "%g", hsp.getEvalue());
+    out_ += '\n';
+}
+
+void AlignmentWriter::writePaf(const BlastQuery& query, const BlastHit& hit, const Hsp& hsp,
+                               bool primary)
+{
+    bool backwards = hsp.getHitFrame() < 0;
+    bool reverse = (hsp.getQueryFrame() < 0) != backwards;
+    alignment(hsp, backwards);
+
+    append_name(out_, query);
+    out_ += '\t';
+    append_int(out_, query.getQueryLen());
+    out_ += '\t';
+    append_int(out_, std::min(hsp.getQueryFrom(), hsp.getQueryTo()) - 1);
+    out_ += '\t';
+    append_int(out_, std::max(hsp.getQueryFrom(), hsp.getQueryTo()));
+    out_ += reverse ? "\t-\t" : "\t+\t";
+    out_ += hit.getHitAccession();
+    out_ += '\t';
+    append_int(out_, hit.getHitLen());
+    out_ += '\t';
+    append_int(out_, std::min(hsp.getHitFrom(), hsp.getHitTo()) - 1);
+    out_ += '\t';
+    append_int(out_, std::max(hsp.getHitFrom(), hsp.getHitTo()));
+    out_ += '\t';
+    append_int(out_, hsp.getIdentity());
+    out_ += '\t';
+    append_int(out_, hsp.getAlignLen());
+    out_ += primary ? "\t255\ttp:A:P" : "\t255\ttp:A:S";
+    if (!ops_.empty()) {
+        out_ += "\tcg:Z:";
+        append_ops(out_, ops_);
+    }
+    out_ += "\tAS:i:";
+    append_int(out_, hsp.getScore());
+    out_ += "\tNM:i:";
+    append_int(out_, hsp.getMismatches() + hsp.getGaps());
+    out_ += "\tZB:f:";
+    append_float(out_, "%.1f", hsp.getBitScore());
+    out_ += "\tZE:Z:";
+    append_float(out_, "%g", hsp.getEvalue());
+    out_ += '\n';
+}
+
+void AlignmentWriter::flush()
+{
+    const char* p = out_.data();
+    size_t left = out_.size();
+    while (left > 0) {
+        ssize_t n = write(fd_, p, left);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::logic_error("Cannot write '" + path_ + "': " + strerror(errno));
+        }
+        p += n;
+        left -= n;
+    }
+    out_.clear();
+}
@@ -0,0 +1,57 @@
+#ifndef ALIGNMENTWRITER_HPP
+#define ALIGNMENTWRITER_HPP
+
+#include "BlastVisitor.hpp"
+#include "Cigar.hpp"
+
+// Text formats hsps can be written in instead of a database
+enum class AlignmentFormat
+{
+    Sam,    // SAM without @SQ lines; the query is the read
+    Paf     // minimap2's pairwise mapping format, CIGAR in the cg tag
+};
+
+// Writes every hsp of each batch as one line of SAM or PAF, with the
+// CIGAR built from Hsp_qseq and Hsp_hseq. The subject is the reference;
+// an hsp on its minus strand (hit_frame < 0) is written reverse
+// complemented against its plus strand, or only reversed if its residues
+// are amino acids, as in tblastn and tblastx. Lines are collected in a large
+// buffer that is written once per batch, or whenever it fills up.
+class AlignmentWriter : public BlastVisitor
+{
+public:
+    // Write to the file at path, or to stdout for "-". Throws
+    // std::logic_error if it cannot be created.
+    AlignmentWriter(const std::string& path, AlignmentFormat format);
+
+    ~AlignmentWriter();
+
+    AlignmentWriter(const AlignmentWriter&) = delete;
+    AlignmentWriter& operator=(const AlignmentWriter&) = delete;
+
+    // write the SAM header
+    void onStart(BlastCounters& counters, SubjectInterner& subjects);
+
+    void onBatch(std::vector<BlastQuery>& batch);
+
+    // write what is buffered and close the file
+    void onFinish(const BlastCounters& counters);
+
+private:
+    void writeSam(const BlastQuery& query, const BlastHit& hit, const Hsp& hsp, bool primary);
+    void writePaf(const BlastQuery& query, const BlastHit& hit, const Hsp& hsp, bool primary);
+
+    // the CIGAR of hsp into ops_, in the order of the subject's plus strand
+    void alignment(const Hsp& hsp, bool reverse);
+
+    void flush();
+
+    std::string             path_;
+    AlignmentFormat         format_;
+    int                     fd_;
+    std::string             out_;       // lines not yet written
+    std::vector<CigarOp>    ops_;
+    RowId                   written_ = 0;
+};
+
+#endif // ALIGNMENTWRITER_HPP
@@ -1,4 +1,5 @@
 #include "Blast.hpp"
+#include "AlignStats.hpp"
 
 // write an Hsp to an ostream
 std::ostream& operator<<(std::ostream& out, const Hsp& hsp) {
@@ -11,6 +12,23 @@ std::ostream& operator<<(std::ostream& out, const Hsp& hsp) {
     return out;
 }
 
+void Hsp::computeAlignStats()
+{
+    if (!qseq_.empty() && qseq_.size() == hseq_.size()) {
+        AlignStats stats = align_stats(qseq_.data(), hseq_.data(), qseq_.size());
+        mismatches_ = stats.mismatches;
+        gap_opens_ = stats.gap_opens;
+        query_gaps_ = stats.query_gaps;
+        hit_gaps_ = stats.hit_gaps;
+    } else {
+        // without the alignment only the totals are known
+        mismatches_ = align_len_ - identity_ - gaps_;
+        gap_opens_ = query_gaps_ = hit_gaps_ = 0;
+    }
+    pct_identity_ = align_len_ > 0 ? 100.0 * identity_ / align_len_ : 0;
+    pct_positive_ = align_len_ > 0 ? 100.0 * positive_ / align_len_ : 0;
+}
+
 // Write a Hit to an ostream
 std::ostream& operator<<(std::ostream& out, const BlastHit& hit) {
     out << "Hit [" << hit.num_ << "] "
@@ -31,36 +49,152 @@ std::ostream& operator<<(std::ostream& out, const BlastQuery& query) {
     return out;
 }
 
-// split a string
-void strsplit(const std::string& str, char c, std::vector<std::string>& out) {
-    std::string::size_type i = 0;
-    std::string::size_type j = str.find(c);
-    // If no matches are found str.find returns std::string::npos
-    // if this is the case we return the complete input string
-    if (j != std::string::npos) {
-        while (j != std::string::npos) {
-            out.push_back(str.substr(i, j-i));
-            i = ++j;
-            j = str.find(c, j);
-            if (j == std::string::npos)
-                out.push_back(str.substr(i, str.length()));
-        }
-    } else {
-        out.push_back(str);
-    }
-}
-
-
 void BlastHit::setHitId( const std::string& id )  {
-    std::vector<std::string> out;
-    strsplit(id, '|', out);
+    SeqId seqid;
+    parse_seqid(id, seqid);
     // if the defline contains a GI number, we grab only the GI
     // else we grap all of the defline
-    if (out[0] == "gi") {
-        this->id_ = out[1];
+    if (!seqid.gi.empty()) {
+        this->id_.assign(seqid.gi.begin(), seqid.gi.end());
     } else {
         this->id_ = id;
     }
+    this->db_tag_.assign(seqid.db_tag.begin(), seqid.db_tag.end());
+    this->version_ = static_cast<int>(parse_number(seqid.version));
+    this->gi_ = parse_number(seqid.gi);
+}
+
+
+void BlastHit::splitDeflines()  {
+    deflines_.clear();
+    DeflineTokenizer tokens(def_);
+    StringRef id, title;
+    while (tokens.next(id, title)) {
+        SubjectDefline defline;
+        defline.setDeflineNum(deflines_.size() + 1);
+        defline.setDefinition(title);
+        if (deflines_.empty()) {
+            // the first defline is the one of Hit_id and Hit_accession
+            defline.setDbTag(db_tag_);
+            defline.setAccession(accession_);
+            defline.setVersion(version_);
+            defline.setGi(gi_);
+        } else {
+            SeqId seqid;
+            parse_seqid(id, seqid);
+            defline.setDbTag(seqid.db_tag);
+            defline.setAccession(seqid.accession);
+            defline.setVersion(static_cast<int>(parse_number(seqid.version)));
+            defline.setGi(parse_number(seqid.gi));
+        }
+        deflines_.push_back(defline);
+    }
+}
+
+
+
+
+QuerySummary QuerySummary::of(BlastQuery& query, double signif_evalue) {
+    QuerySummary summary;
+    summary.query_id_ = query.getID();
+    for (auto& hit : query.getHit()) {
+        ++summary.num_hits_;
+        if (hit.getHsp().empty()) {
+            continue;
+        }
+        double hit_evalue = hit.getHsp().front().getEvalue();
+        for (auto& hsp : hit.getHsp()) {
+            hit_evalue = std::min(hit_evalue, hsp.getEvalue());
+            summary.max_bit_score_ = std::max(summary.max_bit_score_, hsp.getBitScore());
+        }
+        if (summary.best_hit_id_ == 0 || hit_evalue < summary.best_evalue_) {
+            summary.best_evalue_ = hit_evalue;
+            summary.best_hit_id_ = hit.getID();
+        }
+        if (hit_evalue <= signif_evalue) {
+            ++summary.num_signif_;
+        }
+        summary.num_hsps_ += hit.getHsp().size();
+    }
+    return summary;
+}
+
+
+int merged_length(std::vector<std::pair<int, int>>& intervals) {
+    for (auto& iv : intervals) {
+        if (iv.first > iv.second) {
+            std::swap(iv.first, iv.second);
+        }
+    }
+    std::sort(begin(intervals), end(intervals));
+    int total = 0;
+    int start = 0;
+    int stop = -1;      // [start, stop] is the current run; empty at first
+    for (auto& iv : intervals) {
+        if (stop < start || iv.first > stop + 1) {
+            total += stop - start + 1;
+            start = iv.first;
+            stop = iv.second;
+        } else if (iv.second > stop) {
+            stop = iv.second;
+        }
+    }
+    return total + stop - start + 1;
 }
 
 
+// insert queries and subjects first, then their hits and hsps so that the
+// foreign keys always point to existing rows. Hits and hsps are bound
+// straight from the queries that hold them.
+void insert_batch(SqliteDB& db, std::vector<BlastQuery>& queries,
+                  std::unordered_set<RowId>& written) {
+    bool own_transaction = db.autocommit();
+    if (own_transaction) {
+        db.exec("BEGIN TRANSACTION;");
+    }
+    try {
+        db.insert<BlastQuery>(begin(queries), end(queries));
+        // the subject may already be stored by an earlier run we append to
+        auto subjects = db.cursor(SqliteDB::prepareStatment<BlastSubject>("INSERT OR IGNORE"));
+        auto deflines = db.cursor(SqliteDB::prepareStatment<SubjectDefline>("INSERT OR IGNORE"));
+        for (auto& query : queries)
+        {
+            for (auto& hit : query.getHit())
+            {
+                if (written.insert(hit.getSubjectID()).second) {
+                    BlastSubject subject(hit);
+                    db.insertRow(subjects, subject);
+                    for (auto& defline : hit.getDeflines()) {
+                        defline.setSubjectID(hit.getSubjectID());
+                        db.insertRow(deflines, defline);
+                    }
+                }
+            }
+        }
+        auto hits = db.cursor(SqliteDB::prepareStatment<BlastHit>());
+        auto hsps = db.cursor(SqliteDB::prepareStatment<Hsp>());
+        auto summaries = db.cursor(SqliteDB::prepareStatment<QuerySummary>());
+        for (auto& query : queries)
+        {
+            for (auto& hit : query.getHit())
+            {
+                db.insertRow(hits, hit);
+                for (auto& hsp : hit.getHsp()) {
+                    db.insertRow(hsps, hsp);
+                }
+            }
+        }
+        for (auto& query : queries)
+        {
+            db.insertRow(summaries, query.getSummary());
+        }
+        if (own_transaction) {
+            db.exec("COMMIT;");
+        }
+    } catch (...) {
+        if (own_transaction) {
+            db.rollback();
+        }
+        throw;
+    }
+}
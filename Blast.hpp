@@ -1,7 +1,11 @@
 #ifndef BLAST_HPP
 #define BLAST_HPP
 
+#include <unordered_map>
+#include <unordered_set>
+
 #include "SQLite.hpp"
+#include "Defline.hpp"
 
 using std::cout;
 using std::endl;
@@ -26,6 +30,12 @@ public:
         //cout << "Default destructed hsp: " << this << endl;
     }
 
+    // movable, so that finished hsps are handed on without copying
+    Hsp(const Hsp&) = default;
+    Hsp(Hsp&&) = default;
+    Hsp& operator=(const Hsp&) = default;
+    Hsp& operator=(Hsp&&) = default;
+
     // Construct an Hsp with the given properties
     Hsp( const int& num,
          const double& bit_score,
@@ -44,9 +54,9 @@ public:
          const std::string& qseq,
          const std::string& hseq,
          const std::string& midline,
-         const int& count = 0,
-         const int& hitID = 0,
-         const int& queryID = 0)
+         const RowId& count = 0,
+         const RowId& hitID = 0,
+         const RowId& queryID = 0)
         : num_(num),
           bit_score_(bit_score),
           score_(score),
@@ -72,9 +82,9 @@ public:
     }
 
     // Getters
-    int getID() const { return count_; }
-    int getHitID() const { return hit_id_; }
-    int getQueryID() const { return query_id_; }
+    RowId getID() const { return count_; }
+    RowId getHitID() const { return hit_id_; }
+    RowId getQueryID() const { return query_id_; }
 
     int getHspNum() const { return num_; }
     double getBitScore() const { return bit_score_; }
@@ -90,14 +100,20 @@ public:
     int getPositive() const { return positive_; }
     int getGaps() const { return gaps_; }
     int getAlignLen() const { return align_len_; }
-    std::string getQSeq() const { return qseq_; }
-    std::string getHSeq() const { return hseq_; }
+    const std::string& getQSeq() const { return qseq_; }
+    const std::string& getHSeq() const { return hseq_; }
     std::string getMidline() const { return midline_; }
+    int getMismatches() const { return mismatches_; }
+    int getGapOpens() const { return gap_opens_; }
+    int getQueryGaps() const { return query_gaps_; }
+    int getHitGaps() const { return hit_gaps_; }
+    double getPctIdentity() const { return pct_identity_; }
+    double getPctPositive() const { return pct_positive_; }
 
     // Setters
-    void setID( const int& count ) { count_ = count; }
-    void setHitID( const int& hitID ) { hit_id_ = hitID; }
-    void setQueryID( const int& queryID ) { query_id_ = queryID; }
+    void setID( const RowId& count ) { count_ = count; }
+    void setHitID( const RowId& hitID ) { hit_id_ = hitID; }
+    void setQueryID( const RowId& queryID ) { query_id_ = queryID; }
 
     void setHspNum( const int& num ) { num_ = num; }
     void setBitScore( const double& bit_score )  { bit_score_ = bit_score; }
@@ -117,6 +133,10 @@ public:
     void setHSeq( const std::string& hseq )  { hseq_ = hseq; }
     void setMidline( const std::string& midline )  { midline_ = midline; }
 
+    // Derive mismatches, gap counts, and percentages from qseq, hseq,
+    // identity, positive, and align_len
+    void computeAlignStats();
+
     // SQL Table
     static HspTable& table() {
         static HspTable tbl = HspTable::table("hsp",
@@ -139,7 +159,13 @@ public:
                                               HspColumn("align_len",  makeAttr(&Hsp::align_len_)),
                                               HspColumn("qseq",       makeAttr(&Hsp::qseq_)),
                                               HspColumn("hseq",       makeAttr(&Hsp::hseq_)),
-                                              HspColumn("midline",    makeAttr(&Hsp::midline_))
+                                              HspColumn("midline",    makeAttr(&Hsp::midline_)),
+                                              HspColumn("mismatches", makeAttr(&Hsp::mismatches_)),
+                                              HspColumn("gap_opens",  makeAttr(&Hsp::gap_opens_)),
+                                              HspColumn("query_gaps", makeAttr(&Hsp::query_gaps_)),
+                                              HspColumn("hit_gaps",   makeAttr(&Hsp::hit_gaps_)),
+                                              HspColumn("pct_identity", makeAttr(&Hsp::pct_identity_)),
+                                              HspColumn("pct_positive", makeAttr(&Hsp::pct_positive_))
                                               );
         return tbl;
     }
@@ -165,14 +191,73 @@ protected:
     std::string     qseq_;          // Hit_hsps/Hsp/Hsp_qseq
     std::string     hseq_;          // Hit_hsps/Hsp/Hsp_hseq
     std::string     midline_;       // Hit_hsps/Hsp/Hsp_midline
-
-    int            count_;         // hsp_id; primary key
-    int            hit_id_;        // foreign key
-    int            query_id_;      // foreign key
+    int             mismatches_ = 0;    // derived by computeAlignStats
+    int             gap_opens_ = 0;
+    int             query_gaps_ = 0;
+    int             hit_gaps_ = 0;
+    double          pct_identity_ = 0;
+    double          pct_positive_ = 0;
+
+    RowId          count_;         // hsp_id; primary key
+    RowId          hit_id_;        // foreign key
+    RowId          query_id_;      // foreign key
 };
 
 
 
+// One of the deflines of a subject. nr merges identical sequences into a
+// single entry whose Hit_def joins the deflines of all of them.
+class SubjectDefline
+{
+public:
+    typedef Table<SubjectDefline>   DeflineTable;
+    typedef Column<SubjectDefline>  DeflineColumn;
+
+    SubjectDefline() : subject_id_(0), num_(0), version_(0), gi_(0) {}
+
+    // Getters
+    RowId getSubjectID() const { return subject_id_; }
+    int getDeflineNum() const { return num_; }
+    std::string getDbTag() const { return db_tag_; }
+    std::string getAccession() const { return accession_; }
+    int getVersion() const { return version_; }
+    RowId getGi() const { return gi_; }
+    std::string getDefinition() const { return def_; }
+
+    // Setters
+    void setSubjectID( const RowId& subjectId ) { subject_id_ = subjectId ; }
+    void setDeflineNum( const int& num ) { num_ = num ; }
+    void setDbTag( StringRef tag ) { db_tag_.assign(tag.begin(), tag.end()) ; }
+    void setAccession( StringRef accession ) { accession_.assign(accession.begin(), accession.end()) ; }
+    void setVersion( const int& version ) { version_ = version ; }
+    void setGi( const RowId& gi ) { gi_ = gi ; }
+    void setDefinition( StringRef def ) { def_.assign(def.begin(), def.end()) ; }
+
+    // SQL Table
+    static DeflineTable& table() {
+        static DeflineTable tbl = DeflineTable::table("defline",
+                                                      DeflineColumn("subject_id",  makeAttr(&SubjectDefline::subject_id_)),
+                                                      DeflineColumn("defline_num", makeAttr(&SubjectDefline::num_)),
+                                                      DeflineColumn("db_tag",      makeAttr(&SubjectDefline::db_tag_)),
+                                                      DeflineColumn("accession",   makeAttr(&SubjectDefline::accession_)),
+                                                      DeflineColumn("version",     makeAttr(&SubjectDefline::version_)),
+                                                      DeflineColumn("gi",          makeAttr(&SubjectDefline::gi_)),
+                                                      DeflineColumn("definition",  makeAttr(&SubjectDefline::def_))
+                                                      );
+        return tbl;
+    }
+
+private:
+    RowId           subject_id_;    // subject_id; foreign key
+    int             num_;           // position in Hit_def, from 1
+    std::string     db_tag_;
+    std::string     accession_;
+    int             version_;       // 0 if the accession has none
+    RowId           gi_;            // 0 if there is none
+    std::string     def_;
+};
+
+
 class BlastHit
 {
 public:
@@ -184,6 +269,11 @@ public:
     {
         //cout << "Default constructed hit: " << this << endl;
         num_ = 0;
+        version_ = 0;
+        gi_ = 0;
+        subject_id_ = 0;
+        query_cov_ = 0.0;
+        subject_cov_ = 0.0;
     }
 
     // Default destructor
@@ -192,6 +282,12 @@ public:
         //cout << "Default destructed hit: " << this << endl;
     }
 
+    // movable, so that finished hits are handed on without copying
+    BlastHit(const BlastHit&) = default;
+    BlastHit(BlastHit&&) = default;
+    BlastHit& operator=(const BlastHit&) = default;
+    BlastHit& operator=(BlastHit&&) = default;
+
     // Construct Hit with given properties
     BlastHit( const int& num,
               const std::string& id,
@@ -199,41 +295,61 @@ public:
               const std::string& accession,
               const int& len,
               const std::vector<Hsp>& hsp,
-              const int& count = 0,
-              const int& queryId = 0)
+              const RowId& count = 0,
+              const RowId& queryId = 0)
         : num_(num),
           id_(id),
           def_(def),
           accession_(accession),
           len_(len),
+          version_(0),
+          gi_(0),
           hsp_(hsp),
+          query_cov_(0.0),
+          subject_cov_(0.0),
           count_(count),
-          query_id_(queryId)
+          query_id_(queryId),
+          subject_id_(0)
     {
         //cout << "Constructed hit: " << this << endl;
     }
 
     // Getters
-    int getID() const { return count_ ; }
-    int getQueryID() const { return query_id_ ; }
+    RowId getID() const { return count_ ; }
+    RowId getQueryID() const { return query_id_ ; }
 
     int getHitNum() const { return num_; }
     std::string getHitId() const { return id_; }
     std::string getHitDef() const { return def_; }
-    std::string getHitAccession() const { return accession_; }
+    const std::string& getHitAccession() const { return accession_; }
     int getHitLen() const { return len_; }
+    std::string getDbTag() const { return db_tag_; }
+    int getVersion() const { return version_; }
+    RowId getGi() const { return gi_; }
+    std::vector<SubjectDefline>& getDeflines() { return deflines_; }
+    RowId getSubjectID() const { return subject_id_; }
     std::vector<Hsp>& getHsp() { return hsp_; }
+    double getQueryCoverage() const { return query_cov_; }
+    double getSubjectCoverage() const { return subject_cov_; }
 
     // Setters
-    void setID( const int& count ) { count_ = count ; }
-    void setQueryID( const int& queryId ) { query_id_ = queryId ; }
+    void setID( const RowId& count ) { count_ = count ; }
+    void setQueryID( const RowId& queryId ) { query_id_ = queryId ; }
 
     void setHitNum( const int& num ) { num_ = num ; }
+    // Sets gene_id (the GI if there is one, else all of id) and the
+    // db_tag, version, and gi parsed from id
     void setHitId( const std::string& id );
     void setHitDef( const std::string& def )  { def_ = def ; }
     void setHitAccession( const std::string& accession )  { accession_ = accession ; }
     void setHitLen( const unsigned int& len ) { len_ = len ; }
+    void setSubjectID( const RowId& subjectId ) { subject_id_ = subjectId ; }
+    // split the Hit_def into its deflines (call once Hit_accession is set)
+    void splitDeflines();
     void setHsp( const std::vector<Hsp>& hsp )  { hsp_ = hsp ; }
+    void setHsp( std::vector<Hsp>&& hsp )  { hsp_ = std::move(hsp) ; }
+    void setQueryCoverage( const double& cov ) { query_cov_ = cov ; }
+    void setSubjectCoverage( const double& cov ) { subject_cov_ = cov ; }
 
     // SQL Table
     static HitTable& table() {
@@ -241,10 +357,9 @@ public:
                                               HitColumn("query_id",   makeAttr(&BlastHit::query_id_)),
                                               HitColumn("hit_id",     makeAttr(&BlastHit::count_)),
                                               HitColumn("hit_num",    makeAttr(&BlastHit::num_)),
-                                              HitColumn("gene_id",    makeAttr(&BlastHit::id_)),
-                                              HitColumn("accession",  makeAttr(&BlastHit::accession_)),
-                                              HitColumn("definition", makeAttr(&BlastHit::def_)),
-                                              HitColumn("length",     makeAttr(&BlastHit::len_))
+                                              HitColumn("subject_id", makeAttr(&BlastHit::subject_id_)),
+                                              HitColumn("query_coverage",   makeAttr(&BlastHit::query_cov_)),
+                                              HitColumn("subject_coverage", makeAttr(&BlastHit::subject_cov_))
                                               );
         return tbl;
     }
@@ -258,10 +373,182 @@ protected:
     std::string         def_;       // Hit/Hit_def
     std::string         accession_; // Hit/Hit_accession
     int                 len_;       // Hit/Hit_len
+    std::string         db_tag_;    // Hit/Hit_id database tag, e.g. "ref"
+    int                 version_;   // Hit/Hit_id accession version, or 0
+    RowId               gi_;        // Hit/Hit_id GI number, or 0
+    std::vector<SubjectDefline> deflines_;  // Hit/Hit_def, if split
     std::vector<Hsp>    hsp_;       // Hit/Hit_hsps/
+    double              query_cov_;     // fraction of the query covered by the hsps
+    double              subject_cov_;   // fraction of the subject covered by the hsps
+
+    RowId              count_;     // hit_id; primary key
+    RowId              query_id_;  // query_id; foreign key
+    RowId              subject_id_;    // subject_id; foreign key into the subject table
+};
+
+
+// A database sequence hit by one or more queries. Hits refer to their
+// subject, so that the definition etc. is stored only once per database.
+class BlastSubject
+{
+public:
+    typedef Table<BlastSubject>     SubjectTable;
+    typedef Column<BlastSubject>    SubjectColumn;
+
+    BlastSubject() : version_(0), gi_(0), len_(0), subject_id_(0) {}
+
+    // The subject of hit
+    BlastSubject(BlastHit& hit)
+        : id_(hit.getHitId()),
+          def_(hit.getHitDef()),
+          accession_(hit.getHitAccession()),
+          db_tag_(hit.getDbTag()),
+          version_(hit.getVersion()),
+          gi_(hit.getGi()),
+          len_(hit.getHitLen()),
+          subject_id_(hit.getSubjectID())
+    {
+    }
 
-    int                count_;     // hit_id; primary key
-    int                query_id_;  // query_id; foreign key
+    // Getters
+    RowId getID() const { return subject_id_; }
+    std::string getGeneId() const { return id_; }
+    std::string getDefinition() const { return def_; }
+    std::string getAccession() const { return accession_; }
+    std::string getDbTag() const { return db_tag_; }
+    int getVersion() const { return version_; }
+    RowId getGi() const { return gi_; }
+    int getLength() const { return len_; }
+
+    // SQL Table
+    static SubjectTable& table() {
+        static SubjectTable tbl = SubjectTable::table("subject",
+                                                      SubjectColumn("subject_id", makeAttr(&BlastSubject::subject_id_)),
+                                                      SubjectColumn("gene_id",    makeAttr(&BlastSubject::id_)),
+                                                      SubjectColumn("db_tag",     makeAttr(&BlastSubject::db_tag_)),
+                                                      SubjectColumn("accession",  makeAttr(&BlastSubject::accession_)),
+                                                      SubjectColumn("version",    makeAttr(&BlastSubject::version_)),
+                                                      SubjectColumn("gi",         makeAttr(&BlastSubject::gi_)),
+                                                      SubjectColumn("definition", makeAttr(&BlastSubject::def_)),
+                                                      SubjectColumn("length",     makeAttr(&BlastSubject::len_))
+                                                      );
+        return tbl;
+    }
+
+private:
+    std::string     id_;            // Hit/Hit_id --> GI if available
+    std::string     def_;           // Hit/Hit_def
+    std::string     accession_;     // Hit/Hit_accession
+    std::string     db_tag_;        // from Hit/Hit_id
+    int             version_;       // from Hit/Hit_id
+    RowId           gi_;            // from Hit/Hit_id
+    int             len_;           // Hit/Hit_len
+
+    RowId           subject_id_;    // subject_id; primary key
+};
+
+
+// Hands out one subject_id per distinct subject (accession and gene id).
+// Ids are kept for the whole parse, across batches, and can be seeded
+// from an existing database when appending.
+class SubjectInterner
+{
+public:
+    SubjectInterner() {}
+
+    // The subject_id of hit's subject; unseen subjects get ++counter
+    RowId intern(const BlastHit& hit, RowId& counter) {
+        setKey(hit.getHitAccession(), hit.getHitId());
+        auto found = ids_.find(key_);
+        if (found != ids_.end()) {
+            return found->second;
+        }
+        RowId id = ++counter;
+        ids_.emplace(key_, id);
+        return id;
+    }
+
+    // Register a subject already stored with id
+    void seed(const std::string& accession, const std::string& gene_id, RowId id) {
+        setKey(accession, gene_id);
+        ids_[key_] = id;
+    }
+
+    size_t size() const { return ids_.size(); }
+
+private:
+    // key_ is reused so that looking up a known subject does not allocate
+    void setKey(const std::string& accession, const std::string& gene_id) {
+        key_.assign(accession);
+        key_ += '\t';
+        key_ += gene_id;
+    }
+
+    std::unordered_map<std::string, RowId>  ids_;
+    std::string                             key_;
+};
+
+
+class BlastQuery;
+
+// Summary statistics of a query, computed when its </Iteration> closes.
+// If a query has no hits, the best_* columns are 0.
+class QuerySummary
+{
+public:
+    typedef Table<QuerySummary>     SummaryTable;
+    typedef Column<QuerySummary>    SummaryColumn;
+
+    QuerySummary()
+        : query_id_(0),
+          best_hit_id_(0),
+          best_evalue_(0.0),
+          max_bit_score_(0.0),
+          num_hits_(0),
+          num_signif_(0),
+          num_hsps_(0)
+    {
+    }
+
+    // Getters
+    RowId getQueryID() const { return query_id_; }
+    RowId getBestHitID() const { return best_hit_id_; }
+    double getBestEvalue() const { return best_evalue_; }
+    double getMaxBitScore() const { return max_bit_score_; }
+    int getNumHits() const { return num_hits_; }
+    int getNumSignif() const { return num_signif_; }
+    int getNumHsps() const { return num_hsps_; }
+
+    // Setters
+    void setQueryID( const RowId& queryId ) { query_id_ = queryId ; }
+    void setBestHitID( const RowId& hitId ) { best_hit_id_ = hitId ; }
+
+    // Summarize the hits of query; a hit is significant if its best hsp
+    // has an e-value of at most signif_evalue
+    static QuerySummary of(BlastQuery& query, double signif_evalue);
+
+    // SQL Table
+    static SummaryTable& table() {
+        static SummaryTable tbl = SummaryTable::table("query_summary",
+                                                      SummaryColumn("query_id",      makeAttr(&QuerySummary::query_id_)),
+                                                      SummaryColumn("best_hit_id",   makeAttr(&QuerySummary::best_hit_id_)),
+                                                      SummaryColumn("best_evalue",   makeAttr(&QuerySummary::best_evalue_)),
+                                                      SummaryColumn("max_bit_score", makeAttr(&QuerySummary::max_bit_score_)),
+                                                      SummaryColumn("num_hits",      makeAttr(&QuerySummary::num_hits_)),
+                                                      SummaryColumn("num_signif",    makeAttr(&QuerySummary::num_signif_)),
+                                                      SummaryColumn("num_hsps",      makeAttr(&QuerySummary::num_hsps_))
+                                                      );
+        return tbl;
+    }
+
+private:
+    RowId       query_id_;      // query_id; primary and foreign key
+    RowId       best_hit_id_;   // hit with the lowest e-value
+    double      best_evalue_;   // lowest hsp e-value
+    double      max_bit_score_; // highest hsp bit score
+    int         num_hits_;      // number of (kept) hits
+    int         num_signif_;    // number of hits with e-value <= threshold
+    int         num_hsps_;      // number of (kept) hsps
 };
 
 
@@ -282,37 +569,46 @@ public:
         //cout << "Default destructed query: " << this << endl;
     }
 
+    // movable, so that finished querys are handed on without copying
+    BlastQuery(const BlastQuery&) = default;
+    BlastQuery(BlastQuery&&) = default;
+    BlastQuery& operator=(const BlastQuery&) = default;
+    BlastQuery& operator=(BlastQuery&&) = default;
+
     // Construct Query with given properties
-    BlastQuery( const int& id,
+    BlastQuery( const RowId& id,
                 const int& num,
                 const std::string& def,
                 const unsigned int& len,
                 const std::vector<BlastHit>& hit )
         :
-          count_(id),
           num_(num),
           def_(def),
           len_(len),
-          hit_(hit)
+          hit_(hit),
+          count_(id)
     {
         //cout << "Constructed query: " << this << endl;
     }
 
     // Getters
-    unsigned int getID() const { return count_; }
+    RowId getID() const { return count_; }
 
     int getQueryNum() const { return num_; }
-    std::string getQueryDef() const { return def_; }
+    const std::string& getQueryDef() const { return def_; }
     int getQueryLen() const { return len_; }
     std::vector<BlastHit>& getHit() { return hit_; }
+    QuerySummary& getSummary() { return summary_; }
 
     // Setters
-    void setID( const unsigned int& id )  { count_ = id ; }
+    void setID( const RowId& id )  { count_ = id ; }
 
     void setQueryNum( const int& num )  { num_ = num ; }
     void setQueryDef( const std::string& def )  { def_ = def ; }
     void setQueryLen( const int& len ) { len_ = len ; }
     void setHit( const std::vector<BlastHit>& hit )  { hit_ = hit ; }
+    void setHit( std::vector<BlastHit>&& hit )  { hit_ = std::move(hit) ; }
+    void setSummary( const QuerySummary& summary )  { summary_ = summary ; }
 
     // Table
     static QueryTable& table() {
@@ -333,8 +629,20 @@ private:
     std::string             def_;       // Iteration/Iteration_query-def
     int                     len_;       // Iteration/Iteration_query-len
     std::vector<BlastHit>   hit_;       // Iteration/Iteration_hits/
+    QuerySummary            summary_;   // computed at </Iteration>
 
-    int                    count_;     // query_id, primary key
+    RowId                  count_;     // query_id, primary key
 };
 
+// Total length covered by the closed intervals [first, second]. Intervals
+// may run in either direction (reverse strand); they are normalised and
+// sorted in place, so a reused vector makes this allocation free.
+int merged_length(std::vector<std::pair<int, int>>& intervals);
+
+// Insert a batch of queries together with all their hits and hsps into
+// db. Subjects not yet in written are inserted as well, with their split
+// deflines, and added to it.
+void insert_batch(SqliteDB& db, std::vector<BlastQuery>& queries,
+                  std::unordered_set<RowId>& written);
+
 #endif // BLAST_HPP
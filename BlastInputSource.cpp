@@ -0,0 +1,210 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#include "BlastInputSource.hpp"
+
+using std::string;
+
+XMLSize_t StreamBinInputStream::readBytes(XMLByte* const toFill,
+                                          const XMLSize_t maxToRead)
+{
+    in_.read(reinterpret_cast<char*>(toFill), maxToRead);
+    XMLSize_t nread = static_cast<XMLSize_t>(in_.gcount());
+    pos_ += nread;
+    return nread;
+}
+
+
+// ReadaheadBinInputStream
+
+// chunks are aligned to the page size, as the kernel prefers for large reads
+static const size_t CHUNK_ALIGNMENT = 4096;
+
+ReadaheadBinInputStream::ReadaheadBinInputStream(int fd, size_t chunk_size,
+                                                 size_t queue_depth)
+    : fd_(fd),
+      chunk_size_(chunk_size > 0 ? chunk_size : ReadaheadInputSource::DEFAULT_CHUNK_SIZE),
+      pipe_(false),
+      wake_{ -1, -1 },
+      pos_(0),
+      current_({ nullptr, 0 }),
+      current_pos_(0),
+      stop_(false),
+      error_(0)
+{
+    // the reader fills up to queue_depth chunks while the parser reads one
+    size_t nbuffers = std::max<size_t>(queue_depth, 1) + 1;
+    for (size_t i = 0; i < nbuffers; ++i) {
+        void* buffer = nullptr;
+        if (posix_memalign(&buffer, CHUNK_ALIGNMENT, chunk_size_) != 0) {
+            for (auto allocated : buffers_) free(allocated);
+            close(fd_);
+            throw std::bad_alloc();
+        }
+        buffers_.push_back(static_cast<XMLByte*>(buffer));
+    }
+    free_ = buffers_;
+    struct stat st;
+    pipe_ = fstat(fd_, &st) == 0 && !S_ISREG(st.st_mode);
+    // a read from a pipe may block for as long as the writer likes; the
+    // reader waits in poll() instead, which the destructor can interrupt
+    if (pipe_ && pipe(wake_) != 0) {
+        for (auto allocated : buffers_) free(allocated);
+        close(fd_);
+        throw std::logic_error(string("Cannot create a pipe: ") + std::strerror(errno));
+    }
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    reader_ = std::thread(&ReadaheadBinInputStream::run, this);
+}
+
+ReadaheadBinInputStream::~ReadaheadBinInputStream()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    not_full_.notify_one();
+    if (pipe_) {
+        // the parse may end before the input does
+        char wake = 0;
+        while (write(wake_[1], &wake, 1) < 0 && errno == EINTR) {}
+    }
+    reader_.join();
+    if (pipe_) {
+        close(wake_[0]);
+        close(wake_[1]);
+    }
+    close(fd_);
+    for (auto buffer : buffers_) {
+        free(buffer);
+    }
+}
+
+XMLSize_t ReadaheadBinInputStream::readBytes(XMLByte* const toFill,
+                                             const XMLSize_t maxToRead)
+{
+    if (current_pos_ == current_.size) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // hand the used buffer back to the reader and wait for the next
+        if (current_.data != nullptr) {
+            free_.push_back(current_.data);
+            current_ = { nullptr, 0 };
+            not_full_.notify_one();
+        }
+        not_empty_.wait(lock, [this] { return !full_.empty(); });
+        if (full_.front().size == 0) {
+            // keep the end marker queued for any further call
+            if (error_ != 0) {
+                throw std::logic_error(string("Reading the BLAST file failed: ") +
+                                       std::strerror(error_));
+            }
+            return 0;
+        }
+        current_ = full_.front();
+        full_.pop_front();
+        current_pos_ = 0;
+    }
+    XMLSize_t n = std::min<XMLSize_t>(maxToRead, current_.size - current_pos_);
+    std::memcpy(toFill, current_.data + current_pos_, n);
+    current_pos_ += n;
+    pos_ += n;
+    return n;
+}
+
+// the reader thread: fill free buffers with consecutive chunks of the
+// file until its end, a read error, or destruction (which also ends a
+// wait for input from a pipe)
+void ReadaheadBinInputStream::run()
+{
+    while (true) {
+        XMLByte* buffer;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_full_.wait(lock, [this] { return !free_.empty() || stop_; });
+            if (stop_) {
+                return;
+            }
+            buffer = free_.back();
+            free_.pop_back();
+        }
+        size_t filled = 0;
+        int error = 0;
+        bool end = false;
+        while (filled < chunk_size_) {
+            if (pipe_) {
+                struct pollfd fds[2] = { { fd_, POLLIN, 0 }, { wake_[0], POLLIN, 0 } };
+                if (poll(fds, 2, -1) < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    error = errno;
+                    break;
+                }
+                if (fds[1].revents != 0) {
+                    return;     // destruction; the buffers are freed there
+                }
+            }
+            ssize_t n = read(fd_, buffer + filled, chunk_size_ - filled);
+            if (n > 0) {
+                filled += n;
+                // input trickling through a pipe is passed on as it
+                // comes, instead of waiting for a full chunk
+                if (pipe_) {
+                    break;
+                }
+            } else if (n == 0) {
+                end = true;
+                break;
+            } else if (errno != EINTR) {
+                error = errno;
+                break;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (filled > 0) {
+            full_.push_back({ buffer, filled });
+        } else {
+            free_.push_back(buffer);
+        }
+        if (end || error != 0) {
+            error_ = error;
+            full_.push_back({ nullptr, 0 });
+            not_empty_.notify_one();
+            return;
+        }
+        not_empty_.notify_one();
+    }
+}
+
+
+// ReadaheadInputSource
+
+ReadaheadInputSource::ReadaheadInputSource(const std::string& path,
+                                           size_t chunk_size, size_t queue_depth)
+    : InputSource(path.c_str()),
+      path_(path),
+      chunk_size_(chunk_size),
+      queue_depth_(queue_depth)
+{
+    int fd = open(path_.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::logic_error("Cannot open \"" + path_ + "\": " + std::strerror(errno));
+    }
+    close(fd);
+}
+
+xercesc::BinInputStream* ReadaheadInputSource::makeStream() const
+{
+    int fd = open(path_.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    return new ReadaheadBinInputStream(fd, chunk_size_, queue_depth_);
+}
@@ -0,0 +1,118 @@
+#ifndef BLASTINPUTSOURCE_HPP
+#define BLASTINPUTSOURCE_HPP
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <xercesc/sax/InputSource.hpp>
+#include <xercesc/util/BinInputStream.hpp>
+
+// Reads XML from a std::istream
+class StreamBinInputStream : public xercesc::BinInputStream
+{
+public:
+    StreamBinInputStream(std::istream& in) : in_(in), pos_(0) {}
+
+    XMLFilePos curPos() const { return pos_; }
+
+    XMLSize_t readBytes(XMLByte* const toFill, const XMLSize_t maxToRead);
+
+    const XMLCh* getContentType() const { return nullptr; }
+
+private:
+    std::istream&   in_;
+    XMLFilePos      pos_;
+};
+
+
+// InputSource handing out a StreamBinInputStream over in. The stream
+// must outlive the parse.
+class StreamInputSource : public xercesc::InputSource
+{
+public:
+    StreamInputSource(std::istream& in) : in_(in) {}
+
+    xercesc::BinInputStream* makeStream() const {
+        return new StreamBinInputStream(in_);
+    }
+
+private:
+    std::istream& in_;
+};
+
+
+// Reads a file in large page aligned chunks. A background thread keeps up
+// to queue_depth chunks read ahead of the parser, so that the parse is not
+// held up by the latency of every single read (e.g. on network storage).
+class ReadaheadBinInputStream : public xercesc::BinInputStream
+{
+public:
+    // Takes ownership of the open file descriptor fd
+    ReadaheadBinInputStream(int fd, size_t chunk_size, size_t queue_depth);
+
+    ~ReadaheadBinInputStream();
+
+    ReadaheadBinInputStream(const ReadaheadBinInputStream&) = delete;
+    ReadaheadBinInputStream& operator=(const ReadaheadBinInputStream&) = delete;
+
+    XMLFilePos curPos() const { return pos_; }
+
+    // Throws std::logic_error if reading the file failed
+    XMLSize_t readBytes(XMLByte* const toFill, const XMLSize_t maxToRead);
+
+    const XMLCh* getContentType() const { return nullptr; }
+
+private:
+    // a filled buffer; size 0 marks the end of the file
+    struct Chunk {
+        XMLByte*    data;
+        size_t      size;
+    };
+
+    void run();
+
+    int                         fd_;
+    size_t                      chunk_size_;
+    bool                        pipe_;      // not a regular file: pass on every read
+    int                         wake_[2];   // pipe waking a reader waiting for input
+    XMLFilePos                  pos_;
+    std::vector<XMLByte*>       buffers_;   // all buffers, owned
+    std::vector<XMLByte*>       free_;      // buffers the reader may fill
+    std::deque<Chunk>           full_;      // chunks read ahead, in order
+    Chunk                       current_;   // chunk the parser reads from
+    size_t                      current_pos_;
+    bool                        stop_;
+    int                         error_;     // errno of a failed read
+    std::mutex                  mutex_;
+    std::condition_variable     not_empty_;
+    std::condition_variable     not_full_;
+    std::thread                 reader_;
+};
+
+
+// InputSource reading the file at path through a ReadaheadBinInputStream
+class ReadaheadInputSource : public xercesc::InputSource
+{
+public:
+    static const size_t DEFAULT_CHUNK_SIZE = 4 << 20;
+    static const size_t DEFAULT_QUEUE_DEPTH = 4;
+
+    // Throws std::logic_error if path cannot be opened
+    ReadaheadInputSource(const std::string& path,
+                         size_t chunk_size = DEFAULT_CHUNK_SIZE,
+                         size_t queue_depth = DEFAULT_QUEUE_DEPTH);
+
+    xercesc::BinInputStream* makeStream() const;
+
+private:
+    std::string     path_;
+    size_t          chunk_size_;
+    size_t          queue_depth_;
+};
+
+#endif // BLASTINPUTSOURCE_HPP
@@ -0,0 +1,60 @@
+#include <xercesc/util/PlatformUtils.hpp>
+
+#include "BlastParser.hpp"
+#include "BlastSAXHandler.hpp"
+#include "BlastInputSource.hpp"
+#include "PoolMemoryManager.hpp"
+
+BlastParserEnvironment::BlastParserEnvironment()
+{
+    try {
+        XMLPlatformUtils::Initialize();
+    } catch (const XMLException& toCatch) {
+        throw std::logic_error(string("Error during initialisation: ") +
+                               toNative(toCatch.getMessage()));
+    }
+}
+
+BlastParserEnvironment::~BlastParserEnvironment()
+{
+    XMLPlatformUtils::Terminate();
+}
+
+// obtain a parser, register a handler reporting to visitor, and run
+// parse(parser) translating Xerces exceptions into std::logic_error
+template <typename Parse>
+static void runParser(BlastVisitor& visitor, const BlastParseOptions& options,
+                      Parse parse)
+{
+    translate_xml_errors([&] {
+        PoolMemoryManager memory;
+        std::unique_ptr<SAX2XMLReader> parser{ make_blast_reader(&memory) };
+        BlastQueryContentHandler queryHandler(visitor, options);
+        parser->setContentHandler(&queryHandler);
+        parser->setErrorHandler(&queryHandler);
+        parse(*parser);
+    });
+}
+
+void parseBlast(const std::string& path, BlastVisitor& visitor,
+                const BlastParseOptions& options)
+{
+    if (options.read_buffer == 0) {
+        runParser(visitor, options, [&path] (SAX2XMLReader& parser) {
+            parser.parse(path.c_str());
+        });
+        return;
+    }
+    ReadaheadInputSource source(path, options.read_buffer, options.read_queue);
+    runParser(visitor, options, [&source] (SAX2XMLReader& parser) {
+        parser.parse(source);
+    });
+}
+
+void parseBlast(std::istream& in, BlastVisitor& visitor,
+                const BlastParseOptions& options)
+{
+    runParser(visitor, options, [&in] (SAX2XMLReader& parser) {
+        parser.parse(StreamInputSource(in));
+    });
+}
@@ -0,0 +1,64 @@
+#ifndef BLASTPARSER_HPP
+#define BLASTPARSER_HPP
+
+#include <istream>
+#include <memory>
+
+#include "BlastVisitor.hpp"
+#include "IdList.hpp"
+
+// What hits and hsps are ranked by when only the top K are kept
+enum class BlastRank
+{
+    BitScore,   // hsp bit score; a hit ranks by its best hsp
+    Identity,   // identities per alignment column; a hit ranks by its best hsp
+    Coverage    // fraction of the query covered; for a hit, by all its hsps
+};
+
+// Options controlling what is parsed and how often batches are emitted
+struct BlastParseOptions
+{
+    int max_hit = -1;       // max number of hits parsed per query (-1: all)
+    int max_hsp = -1;       // max number of hsps parsed per hit (-1: all)
+    int reset_at = 1000;    // number of queries per batch
+    int top_hits = -1;      // keep the best K of the parsed hits (-1: all)
+    int top_hsps = -1;      // keep the best K of the parsed hsps (-1: all)
+    BlastRank rank_by = BlastRank::BitScore;
+    double signif_evalue = 1e-5;    // hits at or below count as significant
+    bool split_deflines = false;    // split merged Hit_defs into their deflines
+    size_t read_buffer = 4 << 20;   // bytes per read-ahead chunk when parsing a
+                                    // file (0: let Xerces read the file)
+    size_t read_queue = 4;          // number of chunks read ahead
+    int sample_every = 1;           // keep only every K-th query (1: all)
+    int cull = 0;                   // drop hsps covered by cull better ones (0: off)
+    double cull_overlap = 50;       // percent of an hsp's query range each must cover
+    // if set, keep only the queries whose first word of query_def, and
+    // the hits whose accession or Hit_id, is on the list
+    std::shared_ptr<const IdList> query_list;
+    std::shared_ptr<const IdList> subject_list;
+};
+
+// Initialises the XML platform on construction and terminates it on
+// destruction. Create one instance before parsing, on a single thread;
+// parses may then run concurrently on other threads.
+class BlastParserEnvironment
+{
+public:
+    BlastParserEnvironment();
+    ~BlastParserEnvironment();
+
+    BlastParserEnvironment(const BlastParserEnvironment&) = delete;
+    BlastParserEnvironment& operator=(const BlastParserEnvironment&) = delete;
+};
+
+// Parse the BLAST XML file at path and report its contents to visitor.
+// Throws std::logic_error if the document cannot be parsed.
+void parseBlast(const std::string& path, BlastVisitor& visitor,
+                const BlastParseOptions& options = BlastParseOptions());
+
+// Parse BLAST XML read from in and report its contents to visitor.
+// Throws std::logic_error if the document cannot be parsed.
+void parseBlast(std::istream& in, BlastVisitor& visitor,
+                const BlastParseOptions& options = BlastParseOptions());
+
+#endif // BLASTPARSER_HPP
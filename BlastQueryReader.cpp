@@ -0,0 +1,130 @@
+#include <deque>
+
+#include <xercesc/framework/XMLPScanToken.hpp>
+
+#include "BlastQueryReader.hpp"
+#include "BlastSAXHandler.hpp"
+#include "BlastInputSource.hpp"
+#include "PoolMemoryManager.hpp"
+
+// collects each query as the handler completes it
+class QueueVisitor : public BlastVisitor
+{
+public:
+    void onQuery(BlastQuery& query) {
+        queries.push_back(std::move(query));
+    }
+
+    std::deque<BlastQuery> queries;
+};
+
+// everything a progressive scan needs to live as long as the reader
+struct BlastQueryReader::Scan
+{
+    // reads input, or the file path if input is null
+    Scan(const BlastParseOptions& options, xercesc::InputSource* input,
+         const std::string& path = "")
+        : path(path),
+          source(input),
+          handler(visitor, options),
+          parser(make_blast_reader(&memory))
+    {
+        parser->setContentHandler(&handler);
+        parser->setErrorHandler(&handler);
+    }
+
+    QueueVisitor                            visitor;
+    std::string                             path;
+    std::unique_ptr<xercesc::InputSource>   source;
+    BlastQueryContentHandler                handler;
+    PoolMemoryManager                       memory;     // outlives parser
+    std::unique_ptr<SAX2XMLReader>          parser;
+    XMLPScanToken                           token;
+};
+
+// the handler hands each query over at once; batches would only hold
+// the moved-from queries
+static BlastParseOptions unbatched(BlastParseOptions options)
+{
+    options.reset_at = 1;
+    return options;
+}
+
+BlastQueryReader::BlastQueryReader(const std::string& path,
+                                   const BlastParseOptions& options)
+    : cancelled_(false),
+      done_(false)
+{
+    translate_xml_errors([&] {
+        xercesc::InputSource* source = nullptr;
+        if (options.read_buffer > 0) {
+            source = new ReadaheadInputSource(path, options.read_buffer, options.read_queue);
+        }
+        scan_.reset(new Scan(unbatched(options), source, path));
+    });
+    start();
+}
+
+BlastQueryReader::BlastQueryReader(std::istream& in,
+                                   const BlastParseOptions& options)
+    : cancelled_(false),
+      done_(false)
+{
+    translate_xml_errors([&] {
+        scan_.reset(new Scan(unbatched(options), new StreamInputSource(in)));
+    });
+    start();
+}
+
+BlastQueryReader::~BlastQueryReader()
+{
+    if (!done_) {
+        release();
+    }
+}
+
+// end the scan and release its input
+void BlastQueryReader::release()
+{
+    done_ = true;
+    try {
+        scan_->parser->parseReset(scan_->token);
+    } catch (...) {
+    }
+}
+
+void BlastQueryReader::start()
+{
+    done_ = !translate_xml_errors([this] {
+        if (!scan_->source) {
+            return scan_->parser->parseFirst(scan_->path.c_str(), scan_->token);
+        }
+        return scan_->parser->parseFirst(*scan_->source, scan_->token);
+    });
+}
+
+bool BlastQueryReader::next(BlastQuery& query)
+{
+    std::deque<BlastQuery>& queries = scan_->visitor.queries;
+    while (queries.empty() && !done_) {
+        if (cancelled_) {
+            release();
+            break;
+        }
+        try {
+            done_ = !translate_xml_errors([this] {
+                return scan_->parser->parseNext(scan_->token);
+            });
+        } catch (...) {
+            // a broken document is not parsed any further
+            release();
+            throw;
+        }
+    }
+    if (queries.empty() || cancelled_) {
+        return false;
+    }
+    query = std::move(queries.front());
+    queries.pop_front();
+    return true;
+}
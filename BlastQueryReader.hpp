@@ -0,0 +1,63 @@
+#ifndef BLASTQUERYREADER_HPP
+#define BLASTQUERYREADER_HPP
+
+#include <atomic>
+#include <istream>
+#include <memory>
+
+#include "BlastParser.hpp"
+
+// Pull parser handing out one complete query at a time. Only as much of
+// the document is parsed as needed for the next query, so the caller
+// controls the pace, memory stays bounded, and parsing can be abandoned
+// at any point:
+//
+//     BlastQueryReader reader("blastfile.xml");
+//     BlastQuery query;
+//     while (reader.next(query)) {
+//         ... query.getHit() ...
+//     }
+//
+// Queries, hits, and hsps get their ids as with parseBlast. reset_at is
+// ignored, as there are no batches.
+class BlastQueryReader
+{
+public:
+    // Read the BLAST XML file at path. Throws std::logic_error if it
+    // cannot be opened or its start cannot be parsed.
+    BlastQueryReader(const std::string& path,
+                     const BlastParseOptions& options = BlastParseOptions());
+
+    // Read BLAST XML from in, which must outlive the reader
+    BlastQueryReader(std::istream& in,
+                     const BlastParseOptions& options = BlastParseOptions());
+
+    ~BlastQueryReader();
+
+    BlastQueryReader(const BlastQueryReader&) = delete;
+    BlastQueryReader& operator=(const BlastQueryReader&) = delete;
+
+    // Parse up to the end of the next query and move it into query.
+    // Returns false at the end of the document or once cancelled.
+    // Throws std::logic_error if the document cannot be parsed, as when
+    // it is malformed or cut off; the reader is done after that.
+    bool next(BlastQuery& query);
+
+    // Stop parsing; the next call of next() returns false. May be called
+    // from another thread while next() runs.
+    void cancel() { cancelled_ = true; }
+
+    bool done() const { return done_; }
+
+private:
+    struct Scan;
+
+    void start();
+    void release();
+
+    std::unique_ptr<Scan>   scan_;
+    std::atomic<bool>       cancelled_;
+    bool                    done_;
+};
+
+#endif // BLASTQUERYREADER_HPP
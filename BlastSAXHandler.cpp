@@ -1,21 +1,10 @@
 #include "BlastSAXHandler.hpp"
+#include "Defline.hpp"
 
 using std::cout;
 using std::endl;
 
-// static class members
-
-BlastQuery BlastQueryContentHandler::query_ = BlastQuery();
-BlastHit BlastQueryContentHandler::hit_ = BlastHit();
-Hsp BlastQueryContentHandler::hsp_ = Hsp();
-
-bool BlastQueryContentHandler::inside_query_ = false;
-bool BlastQueryContentHandler::inside_hit_ = false;
-bool BlastQueryContentHandler::skip_hit_ = false;
-bool BlastQueryContentHandler::inside_hsp_ = false;
-bool BlastQueryContentHandler::skip_hsp_ = false;
-
-void BlastQueryContentHandler::printState()
+void BlastQueryContentHandler::printState() const
 {
     cout << "inside_query = " << inside_query_
          << "; inside_hit = " << inside_hit_
@@ -28,15 +17,18 @@ void BlastQueryContentHandler::printState()
 // Class methods
 
 
+// let the visitor seed the id counters
 void BlastQueryContentHandler::startDocument() {
     // cout << "Calling startDocument()" << endl;
+    visitor_.onStart(counters_, subjects_);
 }
 
 
-// call dump_to_sqliteDB() to clean up after the last round of parsing
+// call dump_batch() to clean up after the last round of parsing
 void BlastQueryContentHandler::endDocument() {
     // cout << "Calling endDocument()" << endl;
-    this->dump_to_sqliteDB();
+    this->dump_batch();
+    visitor_.onFinish(counters_);
 }
 
 
@@ -50,19 +42,20 @@ void BlastQueryContentHandler::startElement(
     if (qname == iteration)
     {
         // entering a query; set state to 'inside_query'
-        inside_query_   = true;
+        skip_query_     = sample_every_ > 1 && iterations_ % sample_every_ != 0;
+        ++iterations_;
+        inside_query_   = !skip_query_;
         inside_hit_     = false;
         skip_hit_       = false;
         inside_hsp_     = false;
         skip_hsp_       = false;
-        // BlastQueryContentHandler::printState ();
+        // printState();
 
-        // initialize new query, hit, and hsp and count query one up
+        // initialize new query, hit, and hsp; the query gets its id
+        // once we know it is kept
         query_ = BlastQuery();
         hit_ = BlastHit();
         hsp_ = Hsp();
-        query_.setID( ++queryCounter_ );
-        // cout << "Parsing query number: " << queryCounter_ << endl;
     }
     else if (qname == iterationHits)
     {
@@ -70,32 +63,34 @@ void BlastQueryContentHandler::startElement(
         inside_query_   = false;
         inside_hit_     = true;
         inside_hsp_     = false;
-        // BlastQueryContentHandler::printState();
+        // printState();
 
         // clear out the previous 'hit_list'
         hit_list_.clear();
+        hit_heap_.clear();
     }
     else if (qname == hit)
     {
         // entering an individual hit;
         // check if we want to parse all hits (max_hit ==  -1)
         // or if the current hit_num is smaller than max_hit.
-        if ( max_hit_ == -1 || hit_.getHitNum () < max_hit_ )
+        if ( !skip_query_ && (max_hit_ == -1 || hit_.getHitNum () < max_hit_) )
         {
-            // clean up previous hit and hsp; count one up
+            // clean up previous hit and hsp; ids are assigned once the
+            // query is complete and we know which hits are kept
             hit_ = BlastHit();
             hsp_ =  Hsp();
-            hit_.setID( ++hitCounter_ );
-            hit_.setQueryID( query_.getID() );
             inside_hit_ = true;
-            // BlastQueryContentHandler::printState();
+            skip_hit_ = false;
+            skip_hsp_ = false;
+            // printState();
         }
         else
         {
             // switch off hit parsing and hsp parsing
             skip_hit_ = true;
             skip_hsp_ = true;
-            // BlastQueryContentHandler::printState();
+            // printState();
         }
     }
     else if (qname == hitHsps && !skip_hit_)
@@ -104,10 +99,11 @@ void BlastQueryContentHandler::startElement(
         inside_query_   = false;
         inside_hit_     = false;
         inside_hsp_     = true;
-        // BlastQueryContentHandler::printState();
+        // printState();
 
         // and clear out the previous hsp_list
         hsp_list_.clear();
+        hsp_heap_.clear();
     }
     else if (qname == hsp && !skip_hit_ && !skip_hsp_)
     {
@@ -115,18 +111,15 @@ void BlastQueryContentHandler::startElement(
         // check if we want to parse all hsps (max_hsp ==  -1)
         // or if the current hsp_num is smaller than max_hsp.
         if ( max_hsp_ == -1 || hsp_.getHspNum () < max_hsp_ )
-            // clean up the previous hsp and count one up
+            // clean up the previous hsp
         {
             hsp_ = Hsp();
-            hsp_.setID( ++hspCounter_ );
-            hsp_.setHitID( hit_.getID() );
-            hsp_.setQueryID( hit_.getQueryID() );
         }
         else
         {
             // switch off hsp parsing
             skip_hsp_ = true;
-            // BlastQueryContentHandler::printState();
+            // printState();
         }
     }
     else
@@ -146,13 +139,25 @@ void BlastQueryContentHandler::endElement(
     // cout << "Calling endElement( </" << toNative(qname) << "> )" << endl;
     if (qname == hsp && !skip_hsp_)
     {
-        // leave hsp and push it onto hsp_list
-        hsp_list_.push_back(hsp_);
+        // leave hsp and push it onto hsp_list, or offer it to the
+        // top-K heap if we only keep the best hsps
+        hsp_.computeAlignStats();
+        visitor_.onHsp(hsp_);
+        if (top_hsps_ > 0) {
+            double score = rank(hsp_);
+            keep_best(hsp_heap_, top_hsps_, score, std::move(hsp_));
+        } else {
+            hsp_list_.push_back(std::move(hsp_));
+        }
     }
     else if (qname == hitHsps && !skip_hit_)
     {
         // leave the last of the hsps; put hsp_list into the current hit instance
-        hit_.setHsp(hsp_list_);
+        if (top_hsps_ > 0) {
+            take_best(hsp_heap_, hsp_list_);
+        }
+        hit_.setHsp(std::move(hsp_list_));
+        set_coverage(hit_);
 
         // toggle off 'inside_hsp'; toggle on 'inside_hit'
         inside_hsp_ = false;
@@ -160,23 +165,51 @@ void BlastQueryContentHandler::endElement(
     }
     else if (qname == hit && !skip_hit_)
     {
-        // leave hit and push it onto hit_list
-        hit_list_.push_back(hit_);
+        // leave hit and push it onto hit_list, or offer it to the
+        // top-K heap if we only keep the best hits
+        if (split_deflines_) {
+            hit_.splitDeflines();
+        }
+        visitor_.onHit(hit_);
+        if (top_hits_ > 0) {
+            double score = rank(hit_);
+            keep_best(hit_heap_, top_hits_, score, std::move(hit_));
+        } else {
+            hit_list_.push_back(std::move(hit_));
+        }
     }
     else if (qname == iterationHits)
     {
         // leave the last of the hits; put hit_list into the current query instance
-        query_.setHit(hit_list_);
+        if (top_hits_ > 0) {
+            take_best(hit_heap_, hit_list_);
+        }
+        query_.setHit(std::move(hit_list_));
     }
     else if (qname == iteration)
     {
-        // when we leave the query, we push the current query onto query_list_
-        query_list_.push_back(query_);
-        // if we are at a multiple of 'reset_at_', we dump the 'query_list_' to SQLite
-        if (query_.getID() % reset_at_ == 0)
+        // when we leave the query, we number its hits and hsps and
+        // push the current query onto query_list_
+        if (skip_query_) {
+            return;
+        }
+        if (cull_ > 0 && culler_.cull(query_))
+        {
+            for (auto& hit : query_.getHit())
+            {
+                set_coverage(hit);
+            }
+        }
+        query_.setID( ++counters_.queries );
+        assign_ids(query_);
+        query_.setSummary(QuerySummary::of(query_, signif_evalue_));
+        visitor_.onQuery(query_);
+        query_list_.push_back(std::move(query_));
+        // once 'reset_at_' queries have accumulated, we hand the batch to the visitor
+        if (query_list_.size() >= static_cast<size_t>(reset_at_))
         {
-            //cout << "Reset at: " << reset_at_ << "; Parsing query number: " << queryCounter_ << endl;
-            this->dump_to_sqliteDB();
+            //cout << "Reset at: " << reset_at_ << "; Parsing query number: " << counters_.queries << endl;
+            this->dump_batch();
         }
     }
     // for all other nodes we set the appropriate values in query, hit, or hsp
@@ -184,14 +217,21 @@ void BlastQueryContentHandler::endElement(
     {
         if (qname == queryNum)
         {
-            query_.setQueryNum (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            query_.setQueryNum (static_cast<unsigned int> (std::stoi (text ())));
         }
         else if (qname == queryDef)
         {
-            query_.setQueryDef (toNative (currText_));
+            if (query_ids_ && !listed_query (text ()))
+            {
+                // skip the rest of the query, hits and all
+                skip_query_ = true;
+                inside_query_ = false;
+                return;
+            }
+            query_.setQueryDef (text ());
         }
         else if (qname == queryLen) {
-            query_.setQueryLen (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            query_.setQueryLen (static_cast<unsigned int> (std::stoi (text ())));
         }
     }
     else if (inside_hit_ && !skip_hit_)
@@ -199,95 +239,106 @@ void BlastQueryContentHandler::endElement(
         if (qname == hitNum)
         {
             // cout << "Setting HitNum: " << toNative(currText_) << endl;
-            hit_.setHitNum (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            hit_.setHitNum (static_cast<unsigned int> (std::stoi (text ())));
         }
         else if (qname == hitId)
         {
             // cout << "Setting HitId: " << toNative(currText_) << endl;
-            hit_.setHitId (toNative (currText_));
+            hit_.setHitId (text ());
+            if (subject_ids_)
+            {
+                hit_id_ = text_;
+            }
         }
         else if (qname == hitDef)
         {
-            hit_.setHitDef (toNative (currText_));
+            hit_.setHitDef (text ());
         }
         else if (qname == hitAccn)
         {
-            hit_.setHitAccession (toNative (currText_));
+            if (subject_ids_ && !listed_subject (text ()))
+            {
+                // skip the rest of the hit and its hsps
+                skip_hit_ = true;
+                skip_hsp_ = true;
+                return;
+            }
+            hit_.setHitAccession (text ());
         }
         else if (qname == hitLen) {
-            hit_.setHitLen (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            hit_.setHitLen (static_cast<unsigned int> (std::stoi (text ())));
         }
     }
     else if (inside_hsp_ && !skip_hit_ && !skip_hsp_)
     {
         if (qname == hspNum)
         {
-            // cout << "Setting HspNum: " << toNative (currText_) << endl;
-            hsp_.setHspNum (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            // cout << "Setting HspNum: " << text () << endl;
+            hsp_.setHspNum (static_cast<unsigned int> (std::stoi (text ())));
         }
         else if (qname == bitscore)
         {
-            hsp_.setBitScore (static_cast<double> (std::stod (toNative (currText_))));
+            hsp_.setBitScore (static_cast<double> (std::stod (text ())));
         }
         else if (qname == score)
         {
-            hsp_.setScore (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            hsp_.setScore (static_cast<unsigned int> (std::stoi (text ())));
         }
         else if (qname == evalue)
         {
-            hsp_.setEvalue (static_cast<double> (std::stod (toNative (currText_))));
+            hsp_.setEvalue (static_cast<double> (std::stod (text ())));
         }
         else if (qname == queryFrom)
         {
-            hsp_.setQueryFrom (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            hsp_.setQueryFrom (static_cast<unsigned int> (std::stoi (text ())));
         }
         else if (qname == queryTo)
         {
-            hsp_.setQueryTo (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            hsp_.setQueryTo (static_cast<unsigned int> (std::stoi (text ())));
         }
         else if (qname == hitFrom)
         {
-            hsp_.setHitFrom (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            hsp_.setHitFrom (static_cast<unsigned int> (std::stoi (text ())));
         }
         else if (qname == hitTo)
         {
-            hsp_.setHitTo (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            hsp_.setHitTo (static_cast<unsigned int> (std::stoi (text ())));
         }
         else if (qname == queryFrame)
         {
-            hsp_.setQueryFrame (static_cast<int> (std::stoi (toNative (currText_))));
+            hsp_.setQueryFrame (static_cast<int> (std::stoi (text ())));
         }
         else if (qname == hitFrame)
         {
-            hsp_.setHitFrame (static_cast<int> (std::stoi (toNative (currText_))));
+            hsp_.setHitFrame (static_cast<int> (std::stoi (text ())));
         }
         else if (qname == identity)
         {
-            hsp_.setIdentity (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            hsp_.setIdentity (static_cast<unsigned int> (std::stoi (text ())));
         }
         else if (qname == positive)
         {
-            hsp_.setPositive (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            hsp_.setPositive (static_cast<unsigned int> (std::stoi (text ())));
         }
         else if (qname == gaps)
         {
-            hsp_.setGaps (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            hsp_.setGaps (static_cast<unsigned int> (std::stoi (text ())));
         }
         else if (qname == alignLen)
         {
-            hsp_.setAlignLen (static_cast<unsigned int> (std::stoi (toNative (currText_))));
+            hsp_.setAlignLen (static_cast<unsigned int> (std::stoi (text ())));
         }
         else if (qname == qseq)
         {
-            hsp_.setQSeq (toNative (currText_));
+            hsp_.setQSeq (text ());
         }
         else if (qname == hseq)
         {
-            hsp_.setHSeq (toNative (currText_));
+            hsp_.setHSeq (text ());
         }
         else if (qname == midline)
         {
-            hsp_.setMidline (toNative (currText_));
+            hsp_.setMidline (text ());
         }
     }
     else
@@ -299,48 +350,127 @@ void BlastQueryContentHandler::endElement(
 void BlastQueryContentHandler::characters( const XMLCh * const chars,
                                            const XMLSize_t length )
 {
+    // nothing in a skipped query or hit is read
+    if (skip_query_ || skip_hit_) {
+        return;
+    }
     currText_.append(chars, length);
 };
 
 
+// a malformed or truncated document ends the parse with an exception, so
+// that it is not mistaken for a complete one; translate_xml_errors turns
+// it into a std::logic_error
 void BlastQueryContentHandler::fatalError( const SAXParseException& exc )
 {
-    std::string message = toNative (exc.getMessage());
-    std::cout << "Fatal Error: " << message
-              << " at line: " << exc.getLineNumber() << std::endl;
+    throw exc;
 }
 
 
-// dump query, hit, and hsp lists to SQlite DB and clean up;
-void BlastQueryContentHandler::dump_to_sqliteDB()
+// give the hits and hsps of a completed query their primary and
+// foreign keys; only hits that are kept get a subject
+void BlastQueryContentHandler::assign_ids(BlastQuery& query)
 {
-    try {
-        hit_list_.clear();
-        hsp_list_.clear();
-        db_.insert<BlastQuery>(begin(query_list_), end(query_list_));
-        cout << "Processed " << queryCounter_;
-        for (auto& query : query_list_)
-        {
-            std::vector<BlastHit> hits = query.getHit();
-            hit_list_.reserve( hit_list_.size() + hits.size() );
-            hit_list_.insert( end(hit_list_), begin(hits), end(hits) );
-        }
-        query_list_.clear();
-        db_.insert<BlastHit>(begin(hit_list_), end(hit_list_));
-        cout << " queries, " << hitCounter_;
-        for (auto& hit : hit_list_)
+    for (auto& hit : query.getHit())
+    {
+        hit.setID( ++counters_.hits );
+        hit.setQueryID( query.getID() );
+        hit.setSubjectID( subjects_.intern(hit, counters_.subjects) );
+        for (auto& hsp : hit.getHsp())
         {
-            std::vector<Hsp> hsps = hit.getHsp();
-            hsp_list_.reserve( hsp_list_.size() + hsps.size() );
-            hsp_list_.insert( end(hsp_list_), begin(hsps), end(hsps) );
+            hsp.setID( ++counters_.hsps );
+            hsp.setHitID( hit.getID() );
+            hsp.setQueryID( query.getID() );
         }
-        hit_list_.clear();
-        db_.insert<Hsp>(begin(hsp_list_), end(hsp_list_));
-        cout << " hits, and " << hspCounter_ << " hsps." << endl;
-        hsp_list_.clear();
+    }
+}
+
+
+// the score an hsp is ranked by in top-K mode
+double BlastQueryContentHandler::rank(const Hsp& hsp) const
+{
+    switch (rank_by_) {
+    case BlastRank::Identity:
+        return hsp.getAlignLen() > 0 ?
+                    static_cast<double>(hsp.getIdentity()) / hsp.getAlignLen() : 0.0;
+    case BlastRank::Coverage:
+        return query_.getQueryLen() > 0 ?
+                    static_cast<double>(std::abs(hsp.getQueryTo() - hsp.getQueryFrom()) + 1) /
+                    query_.getQueryLen() : 0.0;
+    case BlastRank::BitScore:
+    default:
+        return hsp.getBitScore();
+    }
+}
 
-    } catch (const std::logic_error& toCatch) {
-        cout << toCatch.what() << endl;
+
+// a hit ranks by its best hsp, or by the fraction of the query
+// covered by all of its hsps together
+double BlastQueryContentHandler::rank(BlastHit& hit)
+{
+    if (rank_by_ == BlastRank::Coverage) {
+        return hit.getQueryCoverage();
+    }
+    double best = 0.0;
+    for (auto& hsp : hit.getHsp()) {
+        best = std::max(best, rank(hsp));
+    }
+    return best;
+}
+
+
+// fraction of the query and of the subject covered by the union of
+// the hit's hsps; intervals_ is reused so that this does not allocate
+void BlastQueryContentHandler::set_coverage(BlastHit& hit)
+{
+    intervals_.clear();
+    for (auto& hsp : hit.getHsp()) {
+        intervals_.push_back(std::make_pair(hsp.getQueryFrom(), hsp.getQueryTo()));
+    }
+    hit.setQueryCoverage(query_.getQueryLen() > 0 ?
+                             static_cast<double>(merged_length(intervals_)) / query_.getQueryLen() : 0.0);
+    intervals_.clear();
+    for (auto& hsp : hit.getHsp()) {
+        intervals_.push_back(std::make_pair(hsp.getHitFrom(), hsp.getHitTo()));
     }
+    hit.setSubjectCoverage(hit.getHitLen() > 0 ?
+                               static_cast<double>(merged_length(intervals_)) / hit.getHitLen() : 0.0);
 }
 
+
+// whether the query with this query_def is on the query list; its id is
+// the first word
+bool BlastQueryContentHandler::listed_query(StringRef def) const
+{
+    return query_ids_->contains(def.substr(0, def.find(' ')));
+}
+
+
+// whether the current hit's subject is on the subject list, by its
+// accession, its Hit_id, or the accession in its Hit_id with or without
+// the version
+bool BlastQueryContentHandler::listed_subject(StringRef accession) const
+{
+    if (subject_ids_->contains(accession)) {
+        return true;
+    }
+    if (subject_ids_->contains(hit_id_)) {
+        return true;
+    }
+    SeqId parts;
+    parse_seqid(hit_id_, parts);
+    if (parts.accession != accession && subject_ids_->contains(parts.accession)) {
+        return true;
+    }
+    return !parts.version.empty() &&
+            subject_ids_->contains(StringRef(parts.accession.data(),
+                                              parts.accession.size() + 1 + parts.version.size()));
+}
+
+
+// hand the collected queries over to the visitor and clean up
+void BlastQueryContentHandler::dump_batch()
+{
+    visitor_.onBatch(query_list_);
+    query_list_.clear();
+}
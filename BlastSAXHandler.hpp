@@ -3,59 +3,38 @@
 
 #include <xercesc/sax2/SAX2XMLReader.hpp>
 #include <xercesc/sax2/DefaultHandler.hpp>
+#include <xercesc/sax2/XMLReaderFactory.hpp>
 
-#include "Blast.hpp"
+#include "BlastParser.hpp"
+#include "HspCuller.hpp"
 #include "XercesString.hpp"
 
 using namespace xercesc;
 
 // Callbacks that receive character data and
 // notification about the beginning and end of
-// elements.
+// elements. The parsed queries, hits, and hsps
+// are reported to a BlastVisitor.
 class BlastQueryContentHandler : public DefaultHandler
 {
 public:
-    // Create a new database dbName applying dbSchema
-    BlastQueryContentHandler(std::vector<BlastQuery>& queryList,
-                             std::string dbName,
-                             std::string dbSchema,
-                             int max_hit = -1,
-                             int max_hsp = -1,
-                             int reset_at = 1000)
-        : query_list_(queryList),
-          db_(dbName, dbSchema),
-          queryCounter_(0),
-          hitCounter_(0),
-          hspCounter_(0),
-          max_hit_(max_hit),
-          max_hsp_(max_hsp),
-          reset_at_(reset_at)
+    BlastQueryContentHandler(BlastVisitor& visitor,
+                             const BlastParseOptions& options = BlastParseOptions())
+        : visitor_(visitor),
+          max_hit_(options.max_hit),
+          max_hsp_(options.max_hsp),
+          reset_at_(options.reset_at),
+          top_hits_(options.top_hits),
+          top_hsps_(options.top_hsps),
+          rank_by_(options.rank_by),
+          signif_evalue_(options.signif_evalue),
+          split_deflines_(options.split_deflines),
+          sample_every_(options.sample_every),
+          cull_(options.cull),
+          culler_(options.cull, options.cull_overlap),
+          query_ids_(options.query_list),
+          subject_ids_(options.subject_list)
     {
-        //std::cout << "Max. query = " << queryCounter_ << "\n";
-        //std::cout << "Max. hit = " << hitCounter_ << "\n";
-        //std::cout << "Max. hsp = " << hspCounter_ << "\n";
-    }
-
-    // Open an existing database dbName
-    BlastQueryContentHandler(std::vector<BlastQuery>& queryList,
-                             std::string dbName,
-                             int max_hit = -1,
-                             int max_hsp = -1,
-                             int reset_at = 1000)
-        : query_list_(queryList),
-          db_(dbName),
-          // set query, hit, and hspCounter
-          queryCounter_(db_.max_row("query_id", "query")),
-          hitCounter_(db_.max_row("hit_id", "hit")),
-          hspCounter_(db_.max_row("hsp_id", "hsp")),
-          max_hit_(max_hit),
-          max_hsp_(max_hsp),
-          reset_at_(reset_at)
-
-    {
-        //std::cout << "Max. query = " << queryCounter_ << "\n";
-        //std::cout << "Max. hit = " << hitCounter_ << "\n";
-        //std::cout << "Max. hsp = " << hspCounter_ << "\n";
     }
 
     void startDocument();
@@ -77,17 +56,81 @@ public:
 
     void fatalError(const SAXParseException &exc);
 
-    static void printState();
+    void printState() const;
 
 protected:
-    void dump_to_sqliteDB();
-    std::vector<BlastQuery>&            query_list_;
+    void dump_batch();
+    void assign_ids(BlastQuery& query);
+    double rank(const Hsp& hsp) const;
+    double rank(BlastHit& hit);
+    void set_coverage(BlastHit& hit);
+    bool listed_query(StringRef def) const;
+    bool listed_subject(StringRef accession) const;
+
+    // an item and the score it is ranked by in top-K mode
+    template <typename S>
+    struct Ranked {
+        double  score;
+        S       item;
+    };
+
+    // ranks a before b if it scores higher; ties go to the one BLAST
+    // reported first
+    static bool better(const Ranked<Hsp>& a, const Ranked<Hsp>& b) {
+        return a.score > b.score ||
+                (a.score == b.score && a.item.getHspNum() < b.item.getHspNum());
+    }
+    static bool better(const Ranked<BlastHit>& a, const Ranked<BlastHit>& b) {
+        return a.score > b.score ||
+                (a.score == b.score && a.item.getHitNum() < b.item.getHitNum());
+    }
+
+    // Offer item to a heap holding the k best items seen so far. The heap
+    // top is the worst kept item, which is evicted if item beats it.
+    template <typename S>
+    static void keep_best(std::vector<Ranked<S>>& heap, int k, double score, S&& item) {
+        Ranked<S> candidate = { score, std::move(item) };
+        if (heap.size() < static_cast<size_t>(k)) {
+            heap.push_back(std::move(candidate));
+            std::push_heap(heap.begin(), heap.end(), heap_order<S>);
+        } else if (better(candidate, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), heap_order<S>);
+            heap.back() = std::move(candidate);
+            std::push_heap(heap.begin(), heap.end(), heap_order<S>);
+        }
+    }
+
+    // heap order that puts the worst kept item on top
+    template <typename S>
+    static bool heap_order(const Ranked<S>& a, const Ranked<S>& b) { return better(a, b); }
+
+    // Move the kept items into out, in the order BLAST reported them
+    template <typename S>
+    static void take_best(std::vector<Ranked<S>>& heap, std::vector<S>& out) {
+        out.clear();
+        for (auto& ranked : heap) {
+            out.push_back(std::move(ranked.item));
+        }
+        heap.clear();
+        std::sort(out.begin(), out.end(), [] (const S& a, const S& b) {
+            return reported_before(a, b);
+        });
+    }
+    static bool reported_before(const Hsp& a, const Hsp& b) { return a.getHspNum() < b.getHspNum(); }
+    static bool reported_before(const BlastHit& a, const BlastHit& b) { return a.getHitNum() < b.getHitNum(); }
+
+    BlastVisitor&                       visitor_;
+    std::vector<BlastQuery>             query_list_;
     std::vector<BlastHit>               hit_list_;
     std::vector<Hsp>                    hsp_list_;
     XercesString                        currText_;
+    std::string                         text_;      // currText_ narrowed
 
-    // SQLite database
-    SqliteDB db_;
+    // currText_ narrowed into text_, whose storage is kept between elements
+    const std::string& text() {
+        toNative(currText_, text_);
+        return text_;
+    }
 
     // General Tags
     XercesString iteration = fromNative ("Iteration");
@@ -128,27 +171,80 @@ protected:
     XercesString midline = fromNative ("Hsp_midline");
 
     // counters
-    unsigned int queryCounter_;
-    unsigned int hitCounter_;
-    unsigned int hspCounter_;
+    BlastCounters counters_;
+    SubjectInterner subjects_;
 
     // max number of hits and hsps to be parsed
     int max_hit_;
     int max_hsp_;
     int reset_at_;
 
-    // states
-    static bool inside_query_;
-    static bool inside_hit_;
-    static bool inside_hsp_;
-    static bool skip_hit_;
-    static bool skip_hsp_;
+    // keep only the top K hits per query and hsps per hit
+    int top_hits_;
+    int top_hsps_;
+    BlastRank rank_by_;
+    std::vector<Ranked<BlastHit>>   hit_heap_;
+    std::vector<Ranked<Hsp>>        hsp_heap_;
+    std::vector<std::pair<int, int>> intervals_;
+
+    // e-value threshold for significant hits in the query summary
+    double signif_evalue_;
+
+    // split merged Hit_defs into the deflines of the subject
+    bool split_deflines_;
+
+    // keep only every sample_every_-th query; iterations_ counts them all
+    int sample_every_;
+    RowId iterations_ = 0;
+
+    // drop hsps dominated by better ones on the same query range
+    int cull_;
+    HspCuller culler_;
+
+    // keep only listed queries and subjects, if given
+    std::shared_ptr<const IdList> query_ids_;
+    std::shared_ptr<const IdList> subject_ids_;
+    std::string hit_id_;        // Hit_id as given; the hit keeps only parts
+
+    // states; kept per instance so that several handlers can run
+    // concurrently, one per thread
+    bool inside_query_ = false;
+    bool inside_hit_ = false;
+    bool inside_hsp_ = false;
+    bool skip_hit_ = false;
+    bool skip_hsp_ = false;
+    bool skip_query_ = false;   // not in the sample or not listed
 
     // container for the currently parsed query, hit, and hsp instances
-    static BlastQuery query_;
-    static BlastHit hit_;
-    static Hsp hsp_;
+    BlastQuery query_;
+    BlastHit hit_;
+    Hsp hsp_;
 } ;
 
 
+// Call f, translating the exceptions Xerces throws into std::logic_error
+template <typename F>
+auto translate_xml_errors(F f) -> decltype(f())
+{
+    try {
+        return f();
+    } catch (const XMLException& toCatch) {
+        throw std::logic_error(string("Exception message is: \n") +
+                               toNative(toCatch.getMessage()));
+    } catch (const SAXParseException& toCatch) {
+        throw std::logic_error(string("Fatal Error: ") + toNative(toCatch.getMessage()) +
+                               " at line: " + std::to_string(toCatch.getLineNumber()));
+    }
+}
+
+// A new SAX2 reader set up the way all parses in bigBlastParser use it,
+// allocating from memory (which must outlive it)
+inline SAX2XMLReader* make_blast_reader(MemoryManager* memory = XMLPlatformUtils::fgMemoryManager)
+{
+    SAX2XMLReader* parser = XMLReaderFactory::createXMLReader(memory);
+    parser->setFeature(XMLUni::fgXercesLoadExternalDTD, false);
+    return parser;
+}
+
+
 #endif // BLASTSAXHANDLER_HPP
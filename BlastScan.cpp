@@ -0,0 +1,260 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "BlastScan.hpp"
+
+namespace {
+
+// tag names the scan reacts to
+struct Tag
+{
+    const char* name;
+    size_t      size;
+};
+
+#define TAG(s) { s, sizeof(s) - 1 }
+const Tag ITERATION = TAG("Iteration");
+const Tag ITERATION_END = TAG("/Iteration");
+const Tag QUERY_DEF = TAG("Iteration_query-def");
+const Tag HIT = TAG("Hit");
+const Tag HIT_END = TAG("/Hit");
+const Tag HIT_ID = TAG("Hit_id");
+const Tag HIT_DEF = TAG("Hit_def");
+const Tag HIT_ACCESSION = TAG("Hit_accession");
+const Tag HSP = TAG("Hsp");
+const Tag QSEQ = TAG("Hsp_qseq");
+const Tag HSEQ = TAG("Hsp_hseq");
+const Tag MIDLINE = TAG("Hsp_midline");
+#undef TAG
+
+inline bool is(const char* name, size_t size, const Tag& tag)
+{
+    return size == tag.size && std::memcmp(name, tag.name, size) == 0;
+}
+
+// FNV-1a, enough to tell accessions apart
+inline uint64_t hash_bytes(const char* p, size_t n)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < n; ++i) {
+        h = (h ^ static_cast<unsigned char>(p[i])) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// the share of n parsed items a top-K selection keeps
+inline double kept_share(uint64_t n, int k)
+{
+    return (k > 0 && n > static_cast<uint64_t>(k)) ? double(k) / n : 1.0;
+}
+
+class Scanner
+{
+public:
+    Scanner(const BlastParseOptions& options, BlastScanStats& stats)
+        : options_(options), stats_(stats) {}
+
+    void scan(const char* p, const char* end);
+
+private:
+    void startQuery();
+    void endQuery();
+    void startHit();
+    void endHit();
+
+    const BlastParseOptions&    options_;
+    BlastScanStats&             stats_;
+    std::unordered_set<uint64_t> accessions_;
+
+    bool        query_kept_ = false;
+    uint64_t    query_hits_ = 0;        // parsed hits of the current query
+    double      query_hsps_ = 0;        // and their kept hsps
+    double      query_sequence_ = 0;    // and their sequence bytes
+    bool        hit_kept_ = false;
+    uint64_t    hit_hsps_ = 0;          // parsed hsps of the current hit
+    uint64_t    hit_sequence_ = 0;
+    size_t      hit_text_ = 0;          // Hit_id and Hit_def of the current hit
+    bool        hsp_kept_ = false;
+    uint64_t    hsp_index_ = 0;         // within the current hit
+};
+
+void Scanner::startQuery()
+{
+    query_kept_ = options_.sample_every <= 1 ||
+                  stats_.queries % options_.sample_every == 0;
+    ++stats_.queries;
+    query_hits_ = 0;
+    query_hsps_ = 0;
+    query_sequence_ = 0;
+    hit_kept_ = false;
+    hsp_kept_ = false;
+    if (query_kept_) {
+        ++stats_.kept_queries;
+    }
+}
+
+void Scanner::endQuery()
+{
+    if (!query_kept_) {
+        return;
+    }
+    double share = kept_share(query_hits_, options_.top_hits);
+    stats_.kept_hits += static_cast<uint64_t>(query_hits_ * share + 0.5);
+    stats_.kept_hsps += static_cast<uint64_t>(query_hsps_ * share + 0.5);
+    stats_.sequence_bytes += static_cast<uint64_t>(query_sequence_ * share + 0.5);
+}
+
+void Scanner::startHit()
+{
+    ++stats_.hits;
+    hit_kept_ = query_kept_ && (options_.max_hit == -1 ||
+                                query_hits_ < static_cast<uint64_t>(options_.max_hit));
+    if (hit_kept_) {
+        ++query_hits_;
+    }
+    hit_hsps_ = 0;
+    hit_sequence_ = 0;
+    hit_text_ = 0;
+    hsp_kept_ = false;
+    hsp_index_ = 0;
+}
+
+void Scanner::endHit()
+{
+    if (!hit_kept_) {
+        return;
+    }
+    double share = kept_share(hit_hsps_, options_.top_hsps);
+    query_hsps_ += hit_hsps_ * share;
+    query_sequence_ += hit_sequence_ * share;
+}
+
+void Scanner::scan(const char* p, const char* end)
+{
+    while ((p = static_cast<const char*>(std::memchr(p, '<', end - p))) != nullptr) {
+        const char* name = ++p;
+        const char* gt = static_cast<const char*>(std::memchr(p, '>', end - p));
+        if (gt == nullptr) {
+            break;
+        }
+        // the name ends at whitespace or the '/' of an empty element
+        size_t size = name[0] == '/' ? 1 : 0;
+        while (name + size < gt && !std::isspace(static_cast<unsigned char>(name[size])) &&
+               name[size] != '/') {
+            ++size;
+        }
+        p = gt + 1;
+        if (name[0] == '/') {
+            if (is(name, size, HIT_END)) {
+                endHit();
+            } else if (is(name, size, ITERATION_END)) {
+                endQuery();
+            }
+            continue;
+        }
+        // the text of a leaf element reaches up to the next '<'
+        const char* lt = static_cast<const char*>(std::memchr(p, '<', end - p));
+        size_t text = (lt ? lt : end) - p;
+        switch (size) {
+        case 3:
+            if (is(name, size, HIT)) {
+                startHit();
+            } else if (is(name, size, HSP)) {
+                ++stats_.hsps;
+                hsp_kept_ = hit_kept_ && (options_.max_hsp == -1 ||
+                                          hsp_index_ < static_cast<uint64_t>(options_.max_hsp));
+                ++hsp_index_;
+                hit_hsps_ += hsp_kept_;
+            }
+            break;
+        case 6:
+        case 7:
+            if (hit_kept_ && (is(name, size, HIT_ID) || is(name, size, HIT_DEF))) {
+                hit_text_ += text;
+            }
+            break;
+        case 8:
+        case 11:
+            if (hsp_kept_ && (is(name, size, QSEQ) || is(name, size, HSEQ) ||
+                              is(name, size, MIDLINE))) {
+                hit_sequence_ += text;
+                p += text;
+            }
+            break;
+        case 9:
+            if (is(name, size, ITERATION)) {
+                startQuery();
+            }
+            break;
+        case 13:
+            if (hit_kept_ && is(name, size, HIT_ACCESSION)) {
+                if (accessions_.insert(hash_bytes(p, text)).second) {
+                    ++stats_.subjects;
+                    stats_.subject_bytes += hit_text_ + text;
+                }
+            }
+            break;
+        case 19:
+            if (query_kept_ && is(name, size, QUERY_DEF)) {
+                stats_.query_def_bytes += text;
+            }
+            break;
+        }
+    }
+}
+
+} // namespace
+
+BlastScanStats scanBlast(const std::string& path, const BlastParseOptions& options)
+{
+    auto start = std::chrono::steady_clock::now();
+    BlastScanStats stats;
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        int error = errno;
+        if (fd >= 0) close(fd);
+        throw std::logic_error("Cannot open \"" + path + "\": " + std::strerror(error));
+    }
+    stats.bytes = st.st_size;
+    if (stats.bytes > 0) {
+        void* data = mmap(nullptr, stats.bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            int error = errno;
+            close(fd);
+            throw std::logic_error("Cannot map \"" + path + "\": " + std::strerror(error));
+        }
+        madvise(data, stats.bytes, MADV_SEQUENTIAL);
+        const char* begin = static_cast<const char*>(data);
+        Scanner(options, stats).scan(begin, begin + stats.bytes);
+        munmap(data, stats.bytes);
+    }
+    close(fd);
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+uint64_t projected_db_size(const BlastScanStats& stats, bool lean)
+{
+    // bytes per row beyond its text, with the table's indexes and query
+    // summaries, and the page fill of SQLite's b-trees for text
+    const double per_query = 90;
+    const double per_subject = 75;
+    const double per_hit = lean ? 64 : 84;
+    const double per_hsp = lean ? 116 : 140;
+    const double per_text_byte = 1.07;
+    const double schema = 64 << 10;
+    double text = stats.query_def_bytes + stats.subject_bytes + stats.sequence_bytes;
+    return static_cast<uint64_t>(schema + per_query * stats.kept_queries +
+                                 per_subject * stats.subjects + per_hit * stats.kept_hits +
+                                 per_hsp * stats.kept_hsps + per_text_byte * text);
+}
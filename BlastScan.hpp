@@ -0,0 +1,41 @@
+#ifndef BLASTSCAN_HPP
+#define BLASTSCAN_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "BlastParser.hpp"
+
+// What a quick pass over the raw bytes of a BLAST XML file finds, without
+// parsing it. The kept counts apply max_hit, max_hsp, top_hits,
+// top_hsps, and sample_every as parsing would.
+struct BlastScanStats
+{
+    uint64_t bytes = 0;             // size of the file
+    uint64_t queries = 0;           // <Iteration>s
+    uint64_t hits = 0;              // <Hit>s
+    uint64_t hsps = 0;              // <Hsp>s
+    uint64_t kept_queries = 0;
+    uint64_t kept_hits = 0;
+    uint64_t kept_hsps = 0;
+    uint64_t subjects = 0;          // distinct Hit_accessions of kept hits
+    uint64_t query_def_bytes = 0;   // Iteration_query-def of kept queries
+    uint64_t subject_bytes = 0;     // Hit_id, Hit_def, Hit_accession per subject
+    uint64_t sequence_bytes = 0;    // Hsp_qseq, Hsp_hseq, Hsp_midline of kept hsps
+    double seconds = 0;             // time the scan took
+};
+
+// Count the queries, hits, and hsps of the BLAST XML file at path with
+// memchr over the memory-mapped file. Top-K selections are estimated from
+// the averages of the parsed hits and hsps. Throws std::logic_error if
+// the file cannot be read.
+BlastScanStats scanBlast(const std::string& path,
+                         const BlastParseOptions& options = BlastParseOptions());
+
+// Projected size in bytes of a new database holding what stats counted,
+// for the full or the lean schema. Per-row costs (including indexes) are
+// measured on databases written by this version; --split-deflines rows
+// are not included.
+uint64_t projected_db_size(const BlastScanStats& stats, bool lean);
+
+#endif // BLASTSCAN_HPP
@@ -0,0 +1,62 @@
+#ifndef BLASTVISITOR_HPP
+#define BLASTVISITOR_HPP
+
+#include "Blast.hpp"
+
+// Running id counters of a parse. Every query, hit, and hsp gets the next
+// value of its counter as primary key; every new subject too.
+struct BlastCounters
+{
+    RowId queries = 0;
+    RowId hits = 0;
+    RowId hsps = 0;
+    RowId subjects = 0;
+};
+
+// Add the number of queries, hits, and hsps in batch to counters
+inline void count_batch(std::vector<BlastQuery>& batch, BlastCounters& counters)
+{
+    counters.queries += batch.size();
+    for (auto& query : batch) {
+        counters.hits += query.getHit().size();
+        for (auto& hit : query.getHit()) {
+            counters.hsps += hit.getHsp().size();
+        }
+    }
+}
+
+// Receives the parsed BLAST objects. All callbacks are optional; a visitor
+// only overrides what it needs. Objects are passed by reference and may be
+// modified or moved from (except in onHit and onHsp, where the handler
+// still needs them).
+class BlastVisitor
+{
+public:
+    virtual ~BlastVisitor() {}
+
+    // Called at the start of the document. A visitor may seed the
+    // counters and the known subjects, e.g. to continue the ids of an
+    // existing database.
+    virtual void onStart(BlastCounters& counters, SubjectInterner& subjects) {}
+
+    // Called when an <Hsp> is complete. Ids are not assigned yet, and
+    // in top-K mode the hsp may still be dropped.
+    virtual void onHsp(Hsp& hsp) {}
+
+    // Called when a <Hit> is complete, with all its kept hsps. Ids are
+    // not assigned yet, and in top-K mode the hit may still be dropped.
+    virtual void onHit(BlastHit& hit) {}
+
+    // Called when an <Iteration> is complete, with all its kept hits.
+    // The query, its hits, their subjects, and hsps carry their final ids.
+    virtual void onQuery(BlastQuery& query) {}
+
+    // Called after every reset_at queries and once more with the rest at
+    // the end of the document. The batch is cleared afterwards.
+    virtual void onBatch(std::vector<BlastQuery>& batch) {}
+
+    // Called after the last batch
+    virtual void onFinish(const BlastCounters& counters) {}
+};
+
+#endif // BLASTVISITOR_HPP
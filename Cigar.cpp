@@ -0,0 +1,96 @@
+#include "Cigar.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// extend the last run by len columns of op, or start a new one
+static inline void push_run(std::vector<CigarOp>& ops, char op, int len)
+{
+    if (!ops.empty() && ops.back().op == op) {
+        ops.back().len += len;
+    } else {
+        ops.push_back({ op, len });
+    }
+}
+
+// a gap in the query wins over one in the subject; BLAST never aligns
+// two gaps, so the order only matters for malformed input
+static inline char column_op(char q, char h)
+{
+    return q == '-' ? 'D' : h == '-' ? 'I' : 'M';
+}
+
+static void tail_runs(const char* qseq, const char* hseq, size_t i, size_t n,
+                      std::vector<CigarOp>& ops)
+{
+    for (; i < n; ++i) {
+        push_run(ops, column_op(qseq[i], hseq[i]), 1);
+    }
+}
+
+void cigar_ops_scalar(const char* qseq, const char* hseq, size_t n, std::vector<CigarOp>& ops)
+{
+    ops.clear();
+    tail_runs(qseq, hseq, 0, n, ops);
+}
+
+#ifdef __SSE2__
+
+// bit i set where column i of the 64 columns at p is a gap
+static inline unsigned long long gap_mask(const char* p)
+{
+    const __m128i gap = _mm_set1_epi8('-');
+    unsigned long long mask = 0;
+    for (int k = 0; k < 4; ++k) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * k));
+        mask |= static_cast<unsigned long long>(
+                    static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, gap)))) << (16 * k);
+    }
+    return mask;
+}
+
+void cigar_ops(const char* qseq, const char* hseq, size_t n, std::vector<CigarOp>& ops)
+{
+    ops.clear();
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        unsigned long long d = gap_mask(qseq + i);
+        unsigned long long ins = gap_mask(hseq + i) & ~d;
+        if ((d | ins) == 0) {
+            // the common case: 64 aligned columns
+            push_run(ops, 'M', 64);
+            continue;
+        }
+        unsigned long long m = ~(d | ins);
+        // walk the block run by run; a run of op ends at the first
+        // column not in its mask
+        int pos = 0;
+        while (pos < 64) {
+            char op = 'M';
+            unsigned long long mask = m;
+            if ((d >> pos) & 1) {
+                op = 'D';
+                mask = d;
+            } else if ((ins >> pos) & 1) {
+                op = 'I';
+                mask = ins;
+            }
+            // the shift clears the bits past the block, which end any run
+            unsigned long long rest = ~(mask >> pos);
+            int len = rest ? __builtin_ctzll(rest) : 64 - pos;
+            push_run(ops, op, len);
+            pos += len;
+        }
+    }
+    tail_runs(qseq, hseq, i, n, ops);
+}
+
+#else
+
+void cigar_ops(const char* qseq, const char* hseq, size_t n, std::vector<CigarOp>& ops)
+{
+    cigar_ops_scalar(qseq, hseq, n, ops);
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef CIGAR_HPP
+#define CIGAR_HPP
+
+#include <cstddef>
+#include <vector>
+
+// One run of a CIGAR string, e.g. {'M', 42}
+struct CigarOp
+{
+    char    op;
+    int     len;
+};
+
+// The CIGAR operations of a pairwise alignment given as two equally long
+// gapped strings, as in Hsp_qseq and Hsp_hseq, with the query as the read
+// and the subject as the reference: 'M' for aligned residues, 'I' for
+// query residues against a gap in the subject, and 'D' for subject
+// residues against a gap in the query. Columns are classified 64 at a time
+// with SSE2 where available. The runs replace the contents of ops.
+void cigar_ops(const char* qseq, const char* hseq, size_t n, std::vector<CigarOp>& ops);
+
+// The same one column at a time, as a reference for the vector version
+void cigar_ops_scalar(const char* qseq, const char* hseq, size_t n, std::vector<CigarOp>& ops);
+
+#endif // CIGAR_HPP
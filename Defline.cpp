@@ -0,0 +1,104 @@
+#include <limits>
+
+#include "Defline.hpp"
+
+// the next '|' separated field of rest; rest is advanced past it
+static StringRef next_field(StringRef& rest)
+{
+    size_t bar = rest.find('|');
+    StringRef field = rest.substr(0, bar);
+    rest = bar == StringRef::npos ? StringRef() : rest.substr(bar + 1);
+    return field;
+}
+
+static bool all_digits(StringRef s)
+{
+    if (s.empty()) return false;
+    for (char c : s) {
+        if (c < '0' || c > '9') return false;
+    }
+    return true;
+}
+
+long long parse_number(StringRef digits)
+{
+    if (!all_digits(digits)) return 0;
+    const long long max = std::numeric_limits<long long>::max();
+    long long n = 0;
+    for (char c : digits) {
+        if (n > (max - (c - '0')) / 10) return 0;
+        n = 10 * n + (c - '0');
+    }
+    return n;
+}
+
+void parse_seqid(StringRef id, SeqId& out)
+{
+    out = SeqId();
+    if (id.find('|') == StringRef::npos) {
+        out.accession = id;
+    } else {
+        StringRef rest = id;
+        StringRef tag = next_field(rest);
+        if (tag == "gi") {
+            out.gi = next_field(rest);
+            tag = next_field(rest);
+        }
+        out.db_tag = tag;
+        // general ids name their database before the tag
+        if (tag == "gnl") {
+            next_field(rest);
+        }
+        out.accession = next_field(rest);
+    }
+
+    // "XP_1.2" -> "XP_1" version "2"
+    size_t dot = StringRef::npos;
+    for (size_t i = out.accession.size(); i-- > 0; ) {
+        if (out.accession[i] == '.') {
+            dot = i;
+            break;
+        }
+    }
+    if (dot != StringRef::npos && all_digits(out.accession.substr(dot + 1))) {
+        out.version = out.accession.substr(dot + 1);
+        out.accession = out.accession.substr(0, dot);
+    }
+}
+
+bool DeflineTokenizer::next(StringRef& id, StringRef& title)
+{
+    if (done_) return false;
+
+    // find the next separator: ^A, or '>' after a space
+    size_t end = StringRef::npos, skip = 0;
+    for (size_t i = 0; i < rest_.size(); ++i) {
+        if (rest_[i] == '\x01') {
+            end = i;
+            skip = 1;
+            break;
+        }
+        if (rest_[i] == '>' && i > 0 && rest_[i - 1] == ' ') {
+            end = i - 1;
+            skip = 2;
+            break;
+        }
+    }
+    StringRef defline = rest_.substr(0, end);
+    if (end == StringRef::npos) {
+        done_ = true;
+    } else {
+        rest_ = rest_.substr(end + skip);
+    }
+
+    if (first_) {
+        first_ = false;
+        id = StringRef();
+        title = defline;
+    } else {
+        size_t space = defline.find(' ');
+        id = defline.substr(0, space);
+        title = space == StringRef::npos ? StringRef() : defline.substr(space + 1);
+    }
+    return true;
+}
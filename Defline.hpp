@@ -0,0 +1,41 @@
+#ifndef DEFLINE_HPP
+#define DEFLINE_HPP
+
+#include "StringRef.hpp"
+
+// The parts of an NCBI sequence identifier such as "gi|123|ref|XP_1.2|",
+// "sp|P12345|NAME_HUMAN", "gnl|db|tag", "lcl|seq1", or a bare "XP_1.2".
+// All parts refer into the parsed identifier; missing parts are empty.
+struct SeqId
+{
+    StringRef db_tag;       // "ref", "sp", "gnl", ...
+    StringRef accession;    // without the version
+    StringRef version;      // digits after the last '.' of the accession
+    StringRef gi;           // digits of a leading "gi|<n>"
+};
+
+// Split id into its parts. Does not allocate.
+void parse_seqid(StringRef id, SeqId& out);
+
+// The value of a string of decimal digits, 0 if it is empty, contains
+// anything else, or does not fit 64 bits (GIs exceed 2^31)
+long long parse_number(StringRef digits);
+
+// Iterates over the deflines of a Hit_def joined by " >" (as in nr) or by
+// ^A. The first defline belongs to Hit_id and has no identifier of its
+// own; each following one starts with its identifier.
+class DeflineTokenizer
+{
+public:
+    DeflineTokenizer(StringRef def) : rest_(def), first_(true), done_(false) {}
+
+    // Advance to the next defline; false after the last one
+    bool next(StringRef& id, StringRef& title);
+
+private:
+    StringRef   rest_;
+    bool        first_;
+    bool        done_;
+};
+
+#endif // DEFLINE_HPP
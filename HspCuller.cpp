@@ -0,0 +1,88 @@
+#include <algorithm>
+
+#include "HspCuller.hpp"
+
+bool HspCuller::cull(BlastQuery& query)
+{
+    std::vector<BlastHit>& hits = query.getHit();
+    candidates_.clear();
+    for (auto& hit : hits) {
+        for (auto& hsp : hit.getHsp()) {
+            int from = std::min(hsp.getQueryFrom(), hsp.getQueryTo());
+            int to = std::max(hsp.getQueryFrom(), hsp.getQueryTo());
+            candidates_.push_back({ hsp.getBitScore(), candidates_.size(), from, to });
+        }
+    }
+    if (candidates_.size() <= static_cast<size_t>(limit_)) {
+        return false;
+    }
+
+    // best first; ties go to the hsp reported first
+    std::stable_sort(candidates_.begin(), candidates_.end(),
+                     [] (const Candidate& a, const Candidate& b) { return a.score > b.score; });
+    kept_.clear();
+    longest_ = 0;
+    keep_.assign(candidates_.size(), 0);
+    bool culled = false;
+    for (auto& c : candidates_) {
+        if (dominated(c.from, c.to)) {
+            culled = true;
+        } else {
+            keep_[c.index] = 1;
+            keep(c.from, c.to);
+        }
+    }
+    if (!culled) {
+        return false;
+    }
+
+    // move the kept hsps, and the hits still having any, to the front
+    size_t index = 0;
+    size_t kept_hits = 0;
+    for (auto& hit : hits) {
+        std::vector<Hsp>& hsps = hit.getHsp();
+        bool had_hsps = !hsps.empty();
+        size_t kept_hsps = 0;
+        for (auto& hsp : hsps) {
+            if (keep_[index++]) {
+                if (&hsps[kept_hsps] != &hsp) {
+                    hsps[kept_hsps] = std::move(hsp);
+                }
+                ++kept_hsps;
+            }
+        }
+        hsps.erase(hsps.begin() + kept_hsps, hsps.end());
+        if (kept_hsps > 0 || !had_hsps) {
+            if (&hits[kept_hits] != &hit) {
+                hits[kept_hits] = std::move(hit);
+            }
+            ++kept_hits;
+        }
+    }
+    hits.erase(hits.begin() + kept_hits, hits.end());
+    return true;
+}
+
+bool HspCuller::dominated(int from, int to) const
+{
+    // a kept range overlapping [from, to] starts at most longest_ - 1
+    // before it
+    auto first = std::lower_bound(kept_.begin(), kept_.end(),
+                                  std::make_pair(from - longest_, from - longest_));
+    double needed = overlap_ * (to - from + 1);
+    int covering = 0;
+    for (auto it = first; it != kept_.end() && it->first <= to; ++it) {
+        int overlap = std::min(to, it->second) - std::max(from, it->first) + 1;
+        if (overlap > needed && ++covering >= limit_) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void HspCuller::keep(int from, int to)
+{
+    std::pair<int, int> range(from, to);
+    kept_.insert(std::upper_bound(kept_.begin(), kept_.end(), range), range);
+    longest_ = std::max(longest_, to - from + 1);
+}
@@ -0,0 +1,47 @@
+#ifndef HSPCULLER_HPP
+#define HSPCULLER_HPP
+
+#include <vector>
+
+#include "Blast.hpp"
+
+// Removes the hsps of a query that are dominated by better ones on the
+// same stretch of the query. Going from the highest bit score down, an
+// hsp is dropped if at least limit already kept hsps (of any hit) each
+// cover more than overlap percent of its query range; hits left without
+// hsps are dropped as well.
+class HspCuller
+{
+public:
+    HspCuller(int limit, double overlap) : limit_(limit), overlap_(overlap / 100.0) {}
+
+    // Cull the hsps of query. Returns whether any were dropped.
+    bool cull(BlastQuery& query);
+
+private:
+    // an hsp by its position among the query's hsps in document order,
+    // with its query range [from, to]
+    struct Candidate {
+        double  score;
+        size_t  index;
+        int     from;
+        int     to;
+    };
+
+    // whether limit_ kept ranges cover enough of [from, to]
+    bool dominated(int from, int to) const;
+
+    // add [from, to] to the kept ranges
+    void keep(int from, int to);
+
+    int                 limit_;
+    double              overlap_;
+
+    // reused between queries so that culling does not allocate
+    std::vector<Candidate>              candidates_;
+    std::vector<std::pair<int, int>>    kept_;      // sorted by start
+    int                                 longest_ = 0;
+    std::vector<char>                   keep_;      // by Candidate::index
+};
+
+#endif // HSPCULLER_HPP
@@ -0,0 +1,100 @@
+#include <fstream>
+#include <stdexcept>
+
+#include "IdList.hpp"
+
+// bits set per id; with 10 bits per id this gives about 1% false positives
+static const int BLOOM_HASHES = 7;
+static const size_t BLOOM_BITS_PER_ID = 10;
+
+IdList IdList::fromFile(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        throw std::logic_error("Cannot read id list '" + path + "'.");
+    }
+    std::vector<std::string> ids;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#') {
+            continue;
+        }
+        size_t end = line.find_first_of(" \t\r", begin);
+        ids.push_back(line.substr(begin, end == std::string::npos ? end : end - begin));
+    }
+
+    IdList list;
+    list.reserve(ids.size());
+    for (auto& id : ids) {
+        list.add(id);
+    }
+    return list;
+}
+
+void IdList::reserve(size_t n)
+{
+    size_t bits = 64;
+    while (bits < n * BLOOM_BITS_PER_ID) {
+        bits <<= 1;
+    }
+    bits_.assign(bits / 64, 0);
+    mask_ = bits - 1;
+    ids_.reserve(n);
+}
+
+void IdList::hash(StringRef id, uint64_t& h1, uint64_t& h2)
+{
+    // 64-bit FNV-1a; the second hash is a remix of the first, forced odd
+    // so that all probes differ
+    uint64_t h = 14695981039346656037ULL;
+    for (char c : id) {
+        h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    h1 = h;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h2 = h | 1;
+}
+
+void IdList::add(StringRef id)
+{
+    if (bits_.empty()) {
+        reserve(1024);
+    }
+    if (!ids_.insert(id.str()).second) {
+        return;
+    }
+    uint64_t h1, h2;
+    hash(id, h1, h2);
+    for (int i = 0; i < BLOOM_HASHES; ++i) {
+        uint64_t bit = (h1 + i * h2) & mask_;
+        bits_[bit >> 6] |= 1ULL << (bit & 63);
+    }
+    // keep the false positive rate when ids are added beyond the reserve
+    if (ids_.size() * BLOOM_BITS_PER_ID > mask_ + 1) {
+        std::unordered_set<std::string> ids;
+        ids.swap(ids_);
+        reserve(2 * ids.size());
+        for (auto& each : ids) {
+            add(each);
+        }
+    }
+}
+
+bool IdList::contains(StringRef id) const
+{
+    if (bits_.empty()) {
+        return false;
+    }
+    uint64_t h1, h2;
+    hash(id, h1, h2);
+    for (int i = 0; i < BLOOM_HASHES; ++i) {
+        uint64_t bit = (h1 + i * h2) & mask_;
+        if (!(bits_[bit >> 6] & (1ULL << (bit & 63)))) {
+            return false;
+        }
+    }
+    return ids_.count(id.str()) != 0;
+}
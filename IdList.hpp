@@ -0,0 +1,42 @@
+#ifndef IDLIST_HPP
+#define IDLIST_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "StringRef.hpp"
+
+// A set of identifiers read from a list file, for checking millions of
+// query or subject ids against it while parsing. Lookups first consult a
+// Bloom filter (about 1% false positives), so that most ids not on the
+// list are rejected without hashing a std::string; the rest are confirmed
+// in an exact hash set.
+class IdList
+{
+public:
+    // Read the ids from path: the first word of every line, skipping empty
+    // lines and lines starting with '#'. Throws std::logic_error if the
+    // file cannot be read.
+    static IdList fromFile(const std::string& path);
+
+    void add(StringRef id);
+
+    bool contains(StringRef id) const;
+
+    size_t size() const { return ids_.size(); }
+
+private:
+    // size the Bloom filter for n ids
+    void reserve(size_t n);
+
+    // the bits id sets in the Bloom filter are given by h1 + i * h2
+    static void hash(StringRef id, uint64_t& h1, uint64_t& h2);
+
+    std::vector<uint64_t>           bits_;
+    uint64_t                        mask_ = 0;      // number of bits - 1
+    std::unordered_set<std::string> ids_;
+};
+
+#endif // IDLIST_HPP
@@ -0,0 +1,281 @@
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+
+#include "IngestRegistry.hpp"
+
+// blocks hashed per file, and their size
+static const int FINGERPRINT_BLOCKS = 16;
+static const size_t FINGERPRINT_BLOCK_SIZE = 4096;
+
+static void bind(SqliteDB::RowCursor& stmt, int i, const std::string& text)
+{
+    sqlite3_bind_text(stmt.statement(), i, text.c_str(), text.size(), SQLITE_TRANSIENT);
+}
+
+static void bind(SqliteDB::RowCursor& stmt, int i, sqlite3_int64 value)
+{
+    sqlite3_bind_int64(stmt.statement(), i, value);
+}
+
+std::string file_fingerprint(const std::string& path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        throw std::logic_error("Cannot read '" + path + "'.");
+    }
+    if (!S_ISREG(info.st_mode)) {
+        return "";
+    }
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::logic_error("Cannot read '" + path + "'.");
+    }
+
+    // FNV-1a over the blocks; the first one starts the file, the last
+    // one ends it
+    uint64_t hash = 14695981039346656037ULL;
+    char block[FINGERPRINT_BLOCK_SIZE];
+    off_t size = info.st_size;
+    off_t span = size > static_cast<off_t>(FINGERPRINT_BLOCK_SIZE) ? size - FINGERPRINT_BLOCK_SIZE : 0;
+    for (int k = 0; k < FINGERPRINT_BLOCKS; ++k) {
+        off_t offset = span * k / (FINGERPRINT_BLOCKS - 1);
+        ssize_t got = pread(fd, block, sizeof(block), offset);
+        if (got < 0) {
+            close(fd);
+            throw std::logic_error("Cannot read '" + path + "'.");
+        }
+        for (ssize_t i = 0; i < got; ++i) {
+            hash = (hash ^ static_cast<unsigned char>(block[i])) * 1099511628211ULL;
+        }
+    }
+    close(fd);
+
+    char text[64];
+    snprintf(text, sizeof(text), "%lld-%016llx", static_cast<long long>(size),
+             static_cast<unsigned long long>(hash));
+    return text;
+}
+
+// "<host>:<pid>" of this process
+static std::string this_owner()
+{
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    return std::string(host) + ":" + std::to_string(getpid());
+}
+
+void create_ingest_registry(SqliteDB& db)
+{
+    db.exec(INGESTED_FILES_SCHEMA);
+    std::vector<std::string> present;
+    auto info = db.cursor("PRAGMA table_info(ingested_files);");
+    int name = info.column("name");
+    while (info.next()) {
+        present.push_back(info.getText(name).str());
+    }
+    for (auto column : { "owner", "heartbeat" }) {
+        if (std::find(present.begin(), present.end(), column) == present.end()) {
+            db.exec(std::string("ALTER TABLE ingested_files ADD COLUMN ") + column + " TEXT;");
+        }
+    }
+}
+
+IngestState ingest_state(SqliteDB& db, const std::string& fingerprint)
+{
+    auto file = db.cursor("SELECT finished IS NOT NULL, owner, "
+                          "ifnull(heartbeat < datetime('now', ?2), 1) "
+                          "FROM ingested_files WHERE fingerprint = ?1;");
+    bind(file, 1, fingerprint);
+    bind(file, 2, "-" + std::to_string(INGEST_HEARTBEAT_TIMEOUT) + " seconds");
+    if (!file.next()) {
+        return IngestState::New;
+    }
+    if (file.getInteger(0)) {
+        return IngestState::Complete;
+    }
+    std::string owner = file.getText(1).str();
+    std::string self = this_owner();
+    size_t colon = owner.rfind(':');
+    if (colon != std::string::npos &&
+        owner.compare(0, colon, self, 0, self.rfind(':')) == 0) {
+        // kill() without a signal only checks that the process exists
+        pid_t pid = static_cast<pid_t>(std::atol(owner.c_str() + colon + 1));
+        bool alive = pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+        return alive ? IngestState::Running : IngestState::Interrupted;
+    }
+    return file.getInteger(2) ? IngestState::Interrupted : IngestState::Running;
+}
+
+// remove_ingested inside the caller's transaction
+static bool remove_rows(SqliteDB& db, const std::string& fingerprint, BlastCounters& removed)
+{
+    removed = BlastCounters();
+    auto file = db.cursor("SELECT queries, hits, hsps FROM ingested_files WHERE fingerprint = ?1;");
+    bind(file, 1, fingerprint);
+    if (!file.next()) {
+        return false;
+    }
+    removed.queries = file.getInteger(0);
+    removed.hits = file.getInteger(1);
+    removed.hsps = file.getInteger(2);
+    auto ranges = db.cursor("SELECT first_query_id, last_query_id, first_hit_id, last_hit_id "
+                            "FROM ingested_ranges WHERE fingerprint = ?1;");
+    bind(ranges, 1, fingerprint);
+    // hsps by hit_id and hits by query_id, which both schemas index
+    auto hsps = db.cursor("DELETE FROM hsp WHERE hit_id BETWEEN ?1 AND ?2;");
+    auto hits = db.cursor("DELETE FROM hit WHERE query_id BETWEEN ?1 AND ?2;");
+    auto summaries = db.cursor("DELETE FROM query_summary WHERE query_id BETWEEN ?1 AND ?2;");
+    auto queries = db.cursor("DELETE FROM query WHERE query_id BETWEEN ?1 AND ?2;");
+    while (ranges.next()) {
+        for (auto stmt : { &hsps, &hits, &summaries, &queries }) {
+            // hsps are deleted by the hit range, the rest by the query range
+            int from = stmt == &hsps ? 2 : 0;
+            bind(*stmt, 1, ranges.getInteger(from));
+            bind(*stmt, 2, ranges.getInteger(from + 1));
+            stmt->next();
+            sqlite3_reset(stmt->statement());
+        }
+    }
+
+    // subjects are shared between files; drop those no hit refers to
+    const std::string orphans = "SELECT subject_id FROM subject WHERE NOT EXISTS "
+                                "(SELECT 1 FROM hit WHERE hit.subject_id = subject.subject_id)";
+    db.exec("DELETE FROM defline WHERE subject_id IN (" + orphans + ");");
+    {
+        auto count = db.cursor("SELECT count(*) FROM (" + orphans + ");");
+        count.next();
+        removed.subjects = count.getInteger(0);
+    }
+    db.exec("DELETE FROM subject WHERE subject_id IN (" + orphans + ");");
+
+    for (auto table : { "ingested_ranges", "ingested_files" }) {
+        auto registration = db.cursor(std::string("DELETE FROM ") + table + " WHERE fingerprint = ?1;");
+        bind(registration, 1, fingerprint);
+        registration.next();
+    }
+    return true;
+}
+
+bool remove_ingested(SqliteDB& db, const std::string& fingerprint, BlastCounters& removed)
+{
+    db.exec("BEGIN IMMEDIATE;");
+    try {
+        if (ingest_state(db, fingerprint) == IngestState::Running) {
+            throw std::logic_error("'" + fingerprint + "' is still being stored by another process.");
+        }
+        bool found = remove_rows(db, fingerprint, removed);
+        db.exec(found ? "COMMIT;" : "ROLLBACK;");
+        return found;
+    } catch (...) {
+        db.rollback();
+        throw;
+    }
+}
+
+IngestClaim IngestRegistry::claim(SqliteDB& db, const std::string& fingerprint,
+                                  const std::string& path, IngestPolicy policy,
+                                  IngestState& found, BlastCounters& removed)
+{
+    removed = BlastCounters();
+    db.exec("BEGIN IMMEDIATE;");
+    try {
+        found = ingest_state(db, fingerprint);
+        // a running ingest is never touched; an interrupted one is
+        // replaced unless asked to fail
+        IngestClaim claim = IngestClaim::Claimed;
+        if (found == IngestState::Running) {
+            claim = policy == IngestPolicy::Skip ? IngestClaim::Skipped : IngestClaim::Refused;
+        } else if (found != IngestState::New && policy == IngestPolicy::Fail) {
+            claim = IngestClaim::Refused;
+        } else if (found == IngestState::Complete && policy == IngestPolicy::Skip) {
+            claim = IngestClaim::Skipped;
+        }
+        if (claim != IngestClaim::Claimed) {
+            db.exec("ROLLBACK;");
+            return claim;
+        }
+        if (found != IngestState::New) {
+            remove_rows(db, fingerprint, removed);
+        }
+        struct stat info;
+        stat(path.c_str(), &info);
+        auto file = db.cursor("INSERT INTO ingested_files (fingerprint, path, size, started, "
+                              "queries, hits, hsps, owner, heartbeat) "
+                              "VALUES (?1, ?2, ?3, datetime('now'), 0, 0, 0, ?4, datetime('now'));");
+        bind(file, 1, fingerprint);
+        bind(file, 2, path);
+        bind(file, 3, static_cast<sqlite3_int64>(info.st_size));
+        bind(file, 4, this_owner());
+        file.next();
+        db.exec("COMMIT;");
+    } catch (...) {
+        db.rollback();
+        throw;
+    }
+    fingerprint_ = fingerprint;
+    return IngestClaim::Claimed;
+}
+
+void IngestRegistry::addBatch(SqliteDB& db, const BlastCounters& first, const BlastCounters& size)
+{
+    if (!active()) {
+        return;
+    }
+    // a batch continuing the last range extends it; with concurrent
+    // appenders the ids of other files may come in between
+    bool continues = range_ != 0 && first.queries == next_.queries &&
+                     first.hits == next_.hits && first.hsps == next_.hsps;
+    if (!continues) {
+        first_ = first;
+    }
+    next_.queries = first.queries + size.queries;
+    next_.hits = first.hits + size.hits;
+    next_.hsps = first.hsps + size.hsps;
+
+    if (continues) {
+        auto range = db.cursor("UPDATE ingested_ranges SET last_query_id = ?1, last_hit_id = ?2, "
+                               "last_hsp_id = ?3 WHERE rowid = ?4;");
+        bind(range, 1, next_.queries - 1);
+        bind(range, 2, next_.hits - 1);
+        bind(range, 3, next_.hsps - 1);
+        bind(range, 4, range_);
+        range.next();
+    } else {
+        auto range = db.cursor("INSERT INTO ingested_ranges VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7);");
+        bind(range, 1, fingerprint_);
+        bind(range, 2, first_.queries);
+        bind(range, 3, next_.queries - 1);
+        bind(range, 4, first_.hits);
+        bind(range, 5, next_.hits - 1);
+        bind(range, 6, first_.hsps);
+        bind(range, 7, next_.hsps - 1);
+        range.next();
+        auto rowid = db.cursor("SELECT last_insert_rowid();");
+        rowid.next();
+        range_ = rowid.getInteger(0);
+    }
+
+    auto file = db.cursor("UPDATE ingested_files SET queries = queries + ?1, hits = hits + ?2, "
+                          "hsps = hsps + ?3, heartbeat = datetime('now') WHERE fingerprint = ?4;");
+    bind(file, 1, size.queries);
+    bind(file, 2, size.hits);
+    bind(file, 3, size.hsps);
+    bind(file, 4, fingerprint_);
+    file.next();
+}
+
+void IngestRegistry::finish(SqliteDB& db)
+{
+    if (!active()) {
+        return;
+    }
+    auto file = db.cursor("UPDATE ingested_files SET finished = datetime('now') WHERE fingerprint = ?1;");
+    bind(file, 1, fingerprint_);
+    file.next();
+}
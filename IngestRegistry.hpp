@@ -0,0 +1,86 @@
+#ifndef INGESTREGISTRY_HPP
+#define INGESTREGISTRY_HPP
+
+#include "BlastVisitor.hpp"
+
+// Whether a file is listed in the ingested_files table of a database
+enum class IngestState
+{
+    New,            // not listed
+    Running,        // another process is storing it
+    Interrupted,    // partly stored by a process that is gone
+    Complete        // all of it is stored
+};
+
+// What to do with a file that is listed already
+enum class IngestPolicy
+{
+    Fail,       // refuse it
+    Skip,       // leave it, unless an interrupted ingest is to be replaced
+    Reload      // replace the stored rows, unless another process writes them
+};
+
+enum class IngestClaim
+{
+    Claimed,    // the file is registered as being ingested by this process
+    Skipped,
+    Refused
+};
+
+// An ingest whose owner runs on another host counts as interrupted once
+// its heartbeat is older than this
+const int INGEST_HEARTBEAT_TIMEOUT = 3600;
+
+// The content of the file at path as "<size>-<hash>", without reading all
+// of it: the hash covers 16 blocks of 4 KiB spread evenly over the file.
+// Empty for pipes and other files that are not regular. Throws
+// std::logic_error if the file cannot be read.
+std::string file_fingerprint(const std::string& path);
+
+// Create the ingested_files tables, adding the owner and heartbeat
+// columns to tables of older databases
+void create_ingest_registry(SqliteDB& db);
+
+// An owner on this host is running as long as its process exists; one on
+// another host as long as it renews its heartbeat
+IngestState ingest_state(SqliteDB& db, const std::string& fingerprint);
+
+// Remove the queries, hits, and hsps the file with fingerprint added, the
+// subjects no other hit refers to, and its registration, in one
+// transaction. Returns false if no such file is registered; otherwise
+// removed holds the number of rows taken out. Throws std::logic_error if
+// another process is still storing the file.
+bool remove_ingested(SqliteDB& db, const std::string& fingerprint, BlastCounters& removed);
+
+// Records in a database which rows a file added, batch by batch, in the
+// transaction that writes the batch
+class IngestRegistry
+{
+public:
+    IngestRegistry() {}
+
+    // Register the file at path with fingerprint as being ingested by this
+    // process, as policy says if it is listed already: found is its state
+    // before, and removed counts the rows taken out to replace it. The
+    // check, the removal, and the registration are one transaction, so
+    // that of several appenders of the same file only one gets it.
+    IngestClaim claim(SqliteDB& db, const std::string& fingerprint, const std::string& path,
+                      IngestPolicy policy, IngestState& found, BlastCounters& removed);
+
+    bool active() const { return !fingerprint_.empty(); }
+
+    // Record a batch of size rows whose ids start at first, and renew the
+    // heartbeat
+    void addBatch(SqliteDB& db, const BlastCounters& first, const BlastCounters& size);
+
+    // Mark the file as completely stored
+    void finish(SqliteDB& db);
+
+private:
+    std::string     fingerprint_;
+    BlastCounters   first_;         // of the range recorded last
+    BlastCounters   next_;          // first ids after that range
+    sqlite3_int64   range_ = 0;     // its rowid in ingested_ranges, 0: none
+};
+
+#endif // INGESTREGISTRY_HPP
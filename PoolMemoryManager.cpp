@@ -0,0 +1,82 @@
+#include <new>
+
+#include "PoolMemoryManager.hpp"
+
+// Every block starts with a header naming its size class, padded so that
+// the memory handed out keeps malloc's alignment.
+static const size_t HEADER = 16;
+static const unsigned char LARGE = 0xff;
+
+static int size_class(size_t size)
+{
+    int cls = 0;
+    for (size_t capacity = 16; capacity < size; capacity <<= 1) {
+        ++cls;
+    }
+    return cls;
+}
+
+PoolMemoryManager::PoolMemoryManager()
+    : slab_pos_(nullptr),
+      slab_end_(nullptr)
+{
+    for (int cls = 0; cls < CLASSES; ++cls) {
+        free_[cls] = nullptr;
+    }
+}
+
+PoolMemoryManager::~PoolMemoryManager()
+{
+    for (char* slab : slabs_) {
+        ::operator delete(slab);
+    }
+}
+
+char* PoolMemoryManager::carve(size_t bytes)
+{
+    if (static_cast<size_t>(slab_end_ - slab_pos_) < bytes) {
+        // the rest of the current slab is too small for this class; it
+        // stays unused, as larger classes are rare
+        slabs_.push_back(static_cast<char*>(::operator new(SLAB_SIZE)));
+        slab_pos_ = slabs_.back();
+        slab_end_ = slab_pos_ + SLAB_SIZE;
+    }
+    char* block = slab_pos_;
+    slab_pos_ += bytes;
+    return block;
+}
+
+void* PoolMemoryManager::allocate(XMLSize_t size)
+{
+    char* block;
+    if (size > MAX_POOLED) {
+        block = static_cast<char*>(::operator new(HEADER + size));
+        block[0] = LARGE;
+    } else {
+        int cls = size_class(size);
+        if (free_[cls]) {
+            block = reinterpret_cast<char*>(free_[cls]) - HEADER;
+            free_[cls] = free_[cls]->next;
+        } else {
+            block = carve(HEADER + (size_t(16) << cls));
+        }
+        block[0] = static_cast<unsigned char>(cls);
+    }
+    return block + HEADER;
+}
+
+void PoolMemoryManager::deallocate(void* p)
+{
+    if (!p) {
+        return;
+    }
+    char* block = static_cast<char*>(p) - HEADER;
+    unsigned char cls = block[0];
+    if (cls == LARGE) {
+        ::operator delete(block);
+        return;
+    }
+    FreeBlock* freed = static_cast<FreeBlock*>(p);
+    freed->next = free_[cls];
+    free_[cls] = freed;
+}
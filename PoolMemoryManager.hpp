@@ -0,0 +1,48 @@
+#ifndef POOLMEMORYMANAGER_HPP
+#define POOLMEMORYMANAGER_HPP
+
+#include <vector>
+
+#include <xercesc/util/PlatformUtils.hpp>
+
+// A Xerces MemoryManager serving the small, short-lived blocks a parser
+// allocates for names, attributes, and buffers from free lists carved out
+// of large slabs. Blocks of up to MAX_POOLED bytes never reach malloc
+// once the pool has warmed up; larger ones are passed on to it. Slabs are
+// released with the pool, which therefore has to outlive the parser using
+// it. Not thread safe: give every parser its own pool.
+class PoolMemoryManager : public xercesc::MemoryManager
+{
+public:
+    PoolMemoryManager();
+    ~PoolMemoryManager();
+
+    PoolMemoryManager(const PoolMemoryManager&) = delete;
+    PoolMemoryManager& operator=(const PoolMemoryManager&) = delete;
+
+    void* allocate(XMLSize_t size);
+    void deallocate(void* p);
+
+    // exceptions may outlive the parser and its pool
+    xercesc::MemoryManager* getExceptionMemoryManager() {
+        return xercesc::XMLPlatformUtils::fgMemoryManager;
+    }
+
+    static const size_t MAX_POOLED = 4096;
+
+private:
+    // size classes are powers of two from 16 to MAX_POOLED bytes
+    static const int CLASSES = 9;
+    static const size_t SLAB_SIZE = 256 << 10;
+
+    struct FreeBlock { FreeBlock* next; };
+
+    char* carve(size_t bytes);
+
+    FreeBlock*          free_[CLASSES];
+    std::vector<char*>  slabs_;
+    char*               slab_pos_;      // unused rest of the newest slab
+    char*               slab_end_;
+};
+
+#endif // POOLMEMORYMANAGER_HPP
@@ -20,3 +20,66 @@ std::vector<std::string> split_string(const std::string& s,
     return elems;
 }
 
+
+WalCheckpointer::WalCheckpointer(const string& dbName, int walPages, int interval)
+    : db_(nullptr),
+      wal_pages_(walPages),
+      interval_(interval)
+{
+    if (sqlite3_open_v2(dbName.c_str(), &db_, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, nullptr)) {
+        string message = sqlite3_errmsg(db_);
+        sqlite3_close(db_);
+        throw std::logic_error("Cannot open database " + dbName + " for checkpoints because of " +
+                               message);
+    }
+    // a connection only learns that the database is in WAL mode once it
+    // has read from it; until then checkpoints do nothing
+    sqlite3_exec(db_, "SELECT count(*) FROM sqlite_master;", nullptr, nullptr, nullptr);
+    thread_ = std::thread(&WalCheckpointer::run, this);
+}
+
+WalCheckpointer::~WalCheckpointer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+    sqlite3_close(db_);
+}
+
+int WalCheckpointer::onCommit(void* self, sqlite3*, const char*, int pages)
+{
+    WalCheckpointer* checkpointer = static_cast<WalCheckpointer*>(self);
+    if (checkpointer->wal_pages_ > 0 && pages >= checkpointer->wal_pages_) {
+        {
+            std::lock_guard<std::mutex> lock(checkpointer->mutex_);
+            checkpointer->due_ = true;
+        }
+        checkpointer->wake_.notify_one();
+    }
+    return SQLITE_OK;
+}
+
+void WalCheckpointer::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto due = [this] { return due_ || stop_; };
+    while (!stop_) {
+        if (interval_ > 0) {
+            wake_.wait_for(lock, std::chrono::seconds(interval_), due);
+        } else {
+            wake_.wait(lock, due);
+        }
+        if (stop_) {
+            break;
+        }
+        due_ = false;
+        lock.unlock();
+        // a passive checkpoint copies what it can without waiting for
+        // readers or the writer; the rest is picked up next time
+        sqlite3_wal_checkpoint_v2(db_, nullptr, SQLITE_CHECKPOINT_PASSIVE, nullptr, nullptr);
+        lock.lock();
+    }
+}
@@ -9,13 +9,92 @@
 #include <iterator>
 #include <sstream>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <sqlite3.h>
 
+#include "StringRef.hpp"
+
 using std::cout;
 using std::endl;
 using std::string;
 using std::vector;
 
+// Per-query summary filled in while parsing. IF NOT EXISTS so that it can
+// be added to databases created by older versions when appending.
+const std::string QUERY_SUMMARY_SCHEMA = R"SCHEMA(
+CREATE TABLE IF NOT EXISTS query_summary(
+        query_id      INTEGER,
+        best_hit_id   INTEGER,
+        best_evalue   FLOAT,
+        max_bit_score FLOAT,
+        num_hits      INTEGER,
+        num_signif    INTEGER,
+        num_hsps      INTEGER,
+        PRIMARY KEY (query_id),
+        FOREIGN KEY (query_id) REFERENCES query (query_id)
+        );
+)SCHEMA";
+
+// Deflines of subjects whose Hit_def joins several (nr), filled only with
+// --split-deflines. IF NOT EXISTS for the same reason.
+const std::string DEFLINE_SCHEMA = R"SCHEMA(
+CREATE TABLE IF NOT EXISTS defline(
+        subject_id    INTEGER,
+        defline_num   INTEGER,
+        db_tag        TEXT,
+        accession     TEXT,
+        version       INTEGER,
+        gi            INTEGER,
+        definition    TEXT,
+        PRIMARY KEY (subject_id, defline_num),
+        FOREIGN KEY (subject_id) REFERENCES subject (subject_id)
+        );
+CREATE INDEX IF NOT EXISTS Fdefline_accession ON defline (accession);
+)SCHEMA";
+
+// Next free id per table, for writers that reserve blocks of ids (see
+// SqliteDB::reserveIds). IF NOT EXISTS for appending to older databases.
+const std::string ID_ALLOCATOR_SCHEMA = R"SCHEMA(
+CREATE TABLE IF NOT EXISTS id_allocator(
+        name          TEXT PRIMARY KEY,
+        next_id       INTEGER
+        );
+)SCHEMA";
+
+// Input files parsed into the database, keyed by a fingerprint of their
+// content (see file_fingerprint), and the id ranges of the rows each one
+// added. finished stays NULL until the whole file is stored; until then
+// owner ("<host>:<pid>") and heartbeat, renewed with every batch, tell
+// whether the ingest still runs. IF NOT EXISTS for appending to older
+// databases.
+const std::string INGESTED_FILES_SCHEMA = R"SCHEMA(
+CREATE TABLE IF NOT EXISTS ingested_files(
+        fingerprint   TEXT PRIMARY KEY,
+        path          TEXT,
+        size          INTEGER,
+        started       TEXT,
+        finished      TEXT,
+        queries       INTEGER,
+        hits          INTEGER,
+        hsps          INTEGER,
+        owner         TEXT,
+        heartbeat     TEXT
+        );
+CREATE TABLE IF NOT EXISTS ingested_ranges(
+        fingerprint   TEXT,
+        first_query_id INTEGER,
+        last_query_id  INTEGER,
+        first_hit_id   INTEGER,
+        last_hit_id    INTEGER,
+        first_hsp_id   INTEGER,
+        last_hsp_id    INTEGER,
+        FOREIGN KEY (fingerprint) REFERENCES ingested_files (fingerprint)
+        );
+CREATE INDEX IF NOT EXISTS Fingested_ranges ON ingested_ranges (fingerprint);
+)SCHEMA";
+
 const std::string BLAST_DB_SCHEMA = R"SCHEMA(
 CREATE TABLE query(
         query_id      INTEGER,
@@ -24,16 +103,27 @@ CREATE TABLE query(
         query_len     INTEGER,
         PRIMARY KEY (query_id)
         );
-CREATE TABLE hit(
-        query_id      INTEGER,
-        hit_id        INTEGER,
-        hit_num       INTEGER,
+CREATE TABLE subject(
+        subject_id    INTEGER,
         gene_id       TEXT,
+        db_tag        TEXT,
         accession     TEXT,
+        version       INTEGER,
+        gi            INTEGER,
         definition    TEXT,
         length        INTEGER,
+        PRIMARY KEY (subject_id)
+        );
+CREATE TABLE hit(
+        query_id      INTEGER,
+        hit_id        INTEGER,
+        hit_num       INTEGER,
+        subject_id    INTEGER,
+        query_coverage   FLOAT,
+        subject_coverage FLOAT,
         PRIMARY KEY (hit_id),
-        FOREIGN KEY (query_id) REFERENCES query (query_id)
+        FOREIGN KEY (query_id) REFERENCES query (query_id),
+        FOREIGN KEY (subject_id) REFERENCES subject (subject_id)
         );
 CREATE TABLE hsp(
         query_id      INTEGER,
@@ -56,20 +146,112 @@ CREATE TABLE hsp(
         qseq          TEXT,
         hseq          TEXT,
         midline       TEXT,
+        mismatches    INTEGER,
+        gap_opens     INTEGER,
+        query_gaps    INTEGER,
+        hit_gaps      INTEGER,
+        pct_identity  FLOAT,
+        pct_positive  FLOAT,
         PRIMARY KEY (hsp_id),
         FOREIGN KEY (hit_id) REFERENCES hit (hit_id)
         FOREIGN KEY (query_id) REFERENCES query (query_id)
         );
+)SCHEMA" + QUERY_SUMMARY_SCHEMA + DEFLINE_SCHEMA + ID_ALLOCATOR_SCHEMA +
+    INGESTED_FILES_SCHEMA + R"SCHEMA(
 CREATE INDEX Fquery ON query (query_id);
 CREATE INDEX Fhit ON hit (hit_id);
 CREATE INDEX Fhit_query ON hit (query_id);
 CREATE INDEX Fhit_hit_query ON hit (query_id, hit_id);
+CREATE INDEX Fhit_subject ON hit (subject_id);
+CREATE INDEX Fsubject_accession ON subject (accession);
 CREATE INDEX Fhsp ON hsp (hsp_id);
 CREATE INDEX Fhsp_query ON hsp (query_id);
 CREATE INDEX Fhsp_hit ON hsp (hit_id);
 CREATE INDEX Fhsp_hit_query ON hsp (query_id, hit_id, hsp_id);
+CREATE VIEW hit_subject AS
+        SELECT hit.*, gene_id, db_tag, accession, version, gi, definition, length
+        FROM hit JOIN subject USING (subject_id);
+)SCHEMA";
+
+// Same tables and columns as BLAST_DB_SCHEMA, stored more compactly.
+// query and subject ids are rowid aliases. hit and hsp are WITHOUT ROWID
+// tables clustered on (query_id, hit_num) and (hit_id, hsp_num): as ids
+// are assigned in document order, all hits and hsps of a query are stored
+// contiguously. Only indexes not covered by a primary key are created.
+const std::string LEAN_BLAST_DB_SCHEMA = R"SCHEMA(
+CREATE TABLE query(
+        query_id      INTEGER PRIMARY KEY,
+        query_num     INTEGER,
+        query_def     TEXT,
+        query_len     INTEGER
+        );
+CREATE TABLE subject(
+        subject_id    INTEGER PRIMARY KEY,
+        gene_id       TEXT,
+        db_tag        TEXT,
+        accession     TEXT,
+        version       INTEGER,
+        gi            INTEGER,
+        definition    TEXT,
+        length        INTEGER
+        );
+CREATE TABLE hit(
+        query_id      INTEGER,
+        hit_id        INTEGER,
+        hit_num       INTEGER,
+        subject_id    INTEGER,
+        query_coverage   FLOAT,
+        subject_coverage FLOAT,
+        PRIMARY KEY (query_id, hit_num),
+        FOREIGN KEY (query_id) REFERENCES query (query_id),
+        FOREIGN KEY (subject_id) REFERENCES subject (subject_id)
+        ) WITHOUT ROWID;
+CREATE TABLE hsp(
+        query_id      INTEGER,
+        hit_id        INTEGER,
+        hsp_id        INTEGER,
+        hsp_num       INTEGER,
+        bit_score     FLOAT,
+        score         INTEGER,
+        evalue        FLOAT,
+        query_from    INTEGER,
+        query_to      INTEGER,
+        hit_from      INTEGER,
+        hit_to        INTEGER,
+        query_frame   INTEGER,
+        hit_frame     INTEGER,
+        identity      INTEGER,
+        positive      INTEGER,
+        gaps          INTEGER,
+        align_len     INTEGER,
+        qseq          TEXT,
+        hseq          TEXT,
+        midline       TEXT,
+        mismatches    INTEGER,
+        gap_opens     INTEGER,
+        query_gaps    INTEGER,
+        hit_gaps      INTEGER,
+        pct_identity  FLOAT,
+        pct_positive  FLOAT,
+        PRIMARY KEY (hit_id, hsp_num),
+        FOREIGN KEY (hit_id) REFERENCES hit (hit_id)
+        FOREIGN KEY (query_id) REFERENCES query (query_id)
+        ) WITHOUT ROWID;
+)SCHEMA" + QUERY_SUMMARY_SCHEMA + DEFLINE_SCHEMA + ID_ALLOCATOR_SCHEMA +
+    INGESTED_FILES_SCHEMA + R"SCHEMA(
+CREATE UNIQUE INDEX Fhit ON hit (hit_id);
+CREATE INDEX Fhit_subject ON hit (subject_id);
+CREATE INDEX Fsubject_accession ON subject (accession);
+CREATE INDEX Fhsp_query ON hsp (query_id);
+CREATE VIEW hit_subject AS
+        SELECT hit.*, gene_id, db_tag, accession, version, gi, definition, length
+        FROM hit JOIN subject USING (subject_id);
 )SCHEMA";
 
+// Primary and foreign keys; 64 bit like SQLite's rowids, so that ids do
+// not wrap in runs (or appended databases) with more than 2^31 rows
+typedef sqlite3_int64 RowId;
+
 typedef void(*del)(void*);
 
 vector<string> split_string(const string&, const string&, bool);
@@ -80,7 +262,7 @@ class Attribute
 public:
     Attribute(unsigned char type) : type_(type) {
     }
-    virtual int getInteger(T&) const {
+    virtual sqlite3_int64 getInteger(T&) const {
         throw std::logic_error("getInteger not implemented");
     }
     virtual double getFloat(T&) const {
@@ -89,7 +271,7 @@ public:
     virtual std::string getText(T&) const {
         throw std::logic_error("getText not implemented");
     }
-    virtual void setInteger(T&, int) {
+    virtual void setInteger(T&, sqlite3_int64) {
         throw std::logic_error("setInteger not implemented");
     }
     virtual void setFloat(T&, double) {
@@ -98,6 +280,9 @@ public:
     virtual void setText(T&, const std::string&) {
         throw std::logic_error("setText not implemented");
     }
+    virtual void setText(T&, const char*, size_t) {
+        throw std::logic_error("setText not implemented");
+    }
 
     unsigned char type_;
 };
@@ -115,25 +300,30 @@ public:
     void setText(T& t, const string& text) {
         t.*text_ = text;
     }
+    void setText(T& t, const char* text, size_t size) {
+        (t.*text_).assign(text, size);
+    }
 protected:
     string T::* text_;
 };
 
 
-template <typename T>
+// An integer member of type I (int for counts and coordinates, RowId for
+// ids); all integers are bound and read as 64 bit
+template <typename T, typename I = int>
 class IntegerAttribute : public Attribute<T>
 {
 public:
-    IntegerAttribute(int T::* integer) : Attribute<T>(SQLITE_INTEGER), integer_(integer) {
+    IntegerAttribute(I T::* integer) : Attribute<T>(SQLITE_INTEGER), integer_(integer) {
     }
-    int getInteger(T& t) const {
+    sqlite3_int64 getInteger(T& t) const {
         return t.*integer_;
     }
-    void setInteger(T& t, int integer) {
-        t.*integer_ = integer;
+    void setInteger(T& t, sqlite3_int64 integer) {
+        t.*integer_ = static_cast<I>(integer);
     }
 protected:
-    int T::* integer_;
+    I T::* integer_;
 };
 
 
@@ -157,7 +347,7 @@ protected:
 template<typename S, typename T>
 std::shared_ptr<Attribute<T>>
 makeAttr(S T::* i, typename std::enable_if<std::is_integral<S>::value, S>::type = 0) {
-    return std::make_shared<IntegerAttribute<T> >(i);
+    return std::make_shared<IntegerAttribute<T, S> >(i);
 }
 
 
@@ -220,9 +410,108 @@ public:
 };
 
 
+// Checkpoints the WAL of the database dbName from a connection and thread
+// of its own, so that the writer never waits for it: every interval
+// seconds (if > 0), and as soon as the writer's commits have grown the WAL
+// to walPages pages (if > 0). Checkpoints are passive and do not block
+// readers either.
+class WalCheckpointer
+{
+public:
+    WalCheckpointer(const string& dbName, int walPages, int interval);
+    ~WalCheckpointer();
+
+    WalCheckpointer(const WalCheckpointer&) = delete;
+    WalCheckpointer& operator=(const WalCheckpointer&) = delete;
+
+    // sqlite3_wal_hook callback for the writer; self is the checkpointer
+    static int onCommit(void* self, sqlite3* db, const char* dbName, int pages);
+
+private:
+    void run();
+
+    sqlite3*                    db_;
+    int                         wal_pages_;
+    int                         interval_;
+    std::mutex                  mutex_;
+    std::condition_variable     wake_;
+    bool                        due_ = false;
+    bool                        stop_ = false;
+    std::thread                 thread_;
+};
+
 class SqliteDB
 {
 public:
+    // Row-by-row access to the result of a statement. Values are read
+    // directly by column index; text is returned as a StringRef into
+    // SQLite's buffer, valid until the next call to next().
+    class RowCursor {
+    public:
+        RowCursor(sqlite3* db, const string& sql) : stmt_(nullptr), db_(db)
+        {
+            if (sqlite3_prepare_v2(db, sql.c_str(), sql.size(), &stmt_, nullptr) != SQLITE_OK) {
+                string message = sqlite3_errmsg(db);
+                sqlite3_finalize(stmt_);
+                throw std::logic_error(string("Select statement: \"") + sql +
+                                       "\" failed with error: \"" + message + "\"");
+            }
+        }
+
+        RowCursor(RowCursor&& other) : stmt_(other.stmt_), db_(other.db_) {
+            other.stmt_ = nullptr;
+        }
+
+        RowCursor(const RowCursor&) = delete;
+        RowCursor& operator=(const RowCursor&) = delete;
+
+        ~RowCursor() { sqlite3_finalize(stmt_); }
+
+        // Step to the next row; false once all rows have been read
+        bool next() {
+            int rc = sqlite3_step(stmt_);
+            if (rc == SQLITE_ROW) {
+                return true;
+            } else if (rc != SQLITE_DONE) {
+                throw std::logic_error(string("Stepping a statement failed with error: \"") +
+                                       sqlite3_errmsg(db_) + "\"");
+            }
+            return false;
+        }
+
+        int columns() const { return sqlite3_column_count(stmt_); }
+
+        // Index of the result column called name, or -1. Look indices up
+        // once and not per row.
+        int column(const string& name) const {
+            int ncol = sqlite3_column_count(stmt_);
+            for (int i = 0; i < ncol; ++i) {
+                if (name == sqlite3_column_name(stmt_, i)) {
+                    return i;
+                }
+            }
+            return -1;
+        }
+
+        bool isNull(int i) const { return sqlite3_column_type(stmt_, i) == SQLITE_NULL; }
+        sqlite3_int64 getInteger(int i) const { return sqlite3_column_int64(stmt_, i); }
+        double getFloat(int i) const { return sqlite3_column_double(stmt_, i); }
+        StringRef getText(int i) const {
+            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt_, i));
+            return StringRef(text, sqlite3_column_bytes(stmt_, i));
+        }
+
+        sqlite3_stmt* statement() { return stmt_; }
+
+    private:
+        sqlite3_stmt*   stmt_;
+        sqlite3*        db_;
+    };
+
+    // Input iterator building a T from every row of a statement. The
+    // result columns are matched to the columns of T::table() once per
+    // statement; rows are then read with direct typed accesses.
+    // A default constructed Iterator is the end sentinel.
     template<typename T>
     class Iterator {
     public:
@@ -230,125 +519,112 @@ public:
         typedef T value_type;
         typedef T& reference;
         typedef T* pointer;
-        typedef std::forward_iterator_tag iterator_category;
+        typedef std::input_iterator_tag iterator_category;
         typedef int difference_type;
 
-        Iterator() : resultCode(SQLITE_DONE) {}
+        Iterator() {}
 
-        Iterator(int rsc, sqlite3_stmt* s) : resultCode(rsc), stmt(s)
+        Iterator(RowCursor&& cursor) : state_(std::make_shared<State>(std::move(cursor)))
         {
-            if (resultCode == SQLITE_OK) {
-                resultCode = sqlite3_step(stmt);
-                if (resultCode == SQLITE_ROW) {
-                    buildObj();
-                } else {
-                    sqlite3_finalize(stmt);
-                }
-            } else {
-                sqlite3_finalize(stmt);
-            }
-        }
-
-        inline void buildObj() {
-            int ncol = sqlite3_column_count(stmt);
-            auto tbl = T::table();
-            for (int i = 0; i < ncol; ++i)
-            {
-                string colname = reinterpret_cast<const char*>
-                        (sqlite3_column_name(stmt, i));
-                for (auto col : tbl.column_ )
-                {
-                    if (colname == col.name_) {
-                        switch (col.attr_->type_) {
-                        case SQLITE_INTEGER: {
-                            int Integer = sqlite3_column_int(stmt, i);
-                            col.attr_->setInteger(it, Integer);
-                            break;
-                        }
-                        case SQLITE_FLOAT: {
-                            double Float = sqlite3_column_double(stmt, i);
-                            col.attr_->setFloat(it, Float);
-                            break;
-                        }
-                        case SQLITE_TEXT: {
-                            const string& Text =
-                                    reinterpret_cast<const char*>(
-                                        sqlite3_column_text(stmt, i)
-                                        );
-                            col.attr_->setText(it, Text);
-                            break;
-                        }
-                        default: {
-                            std::stringstream typeStr;
-                            typeStr << "No case for " << col.attr_->type_;
-                            throw std::logic_error(typeStr.str());
-                        }
-                        }
-                        break;
-                    }
+            const Table<T>& tbl = T::table();
+            RowCursor& rows = state_->cursor_;
+            for (auto& col : tbl.column_) {
+                int i = rows.column(col.name_);
+                if (i >= 0) {
+                    state_->binding_.push_back(std::make_pair(i, col.attr_.get()));
                 }
             }
+            advance();
         }
 
-        self_type operator++() {
-            self_type copy = *this;
-            if (resultCode == SQLITE_ROW) {
-                resultCode = sqlite3_step(stmt);
-                if (resultCode == SQLITE_ROW && resultCode != SQLITE_ERROR
-                        && resultCode != SQLITE_DONE) {
-                    buildObj();
-                }
-                return copy;
-            } else {
-                sqlite3_finalize(stmt);
-                return Iterator();
-            }
+        self_type& operator++() {
+            advance();
+            return *this;
         }
 
         reference operator*() { return it; }
         pointer operator->() { return &it; }
 
-        bool operator==(const self_type& rhs) {
-            if (resultCode != rhs.resultCode) {
-                return false;
-            } else if (resultCode == rhs.resultCode
-                       && resultCode == SQLITE_ROW) {
-                int tCnt = sqlite3_column_count(stmt);
-                int oCnt = sqlite3_column_count(rhs.stmt);
+        // iterators are equal if both are exhausted or share a statement
+        bool operator==(const self_type& rhs) const { return state_ == rhs.state_; }
+        bool operator!=(const self_type& rhs) const { return !(*this == rhs); }
 
-                if (tCnt != oCnt) {
-                    return false;
-                }
-
-                // if the column entries are different the it is different
-                for (int it = 0; it < tCnt; ++it)
-                {
-                    string tc = reinterpret_cast<const char*>(
-                                sqlite3_column_text(stmt, it)
-                                );
-                    string oc = reinterpret_cast<const char*>(
-                                sqlite3_column_text(rhs.stmt, it)
-                                );
-                    if (tc != oc) {
-                        return false;
-                    }
-                }
-                return true;
-            } else if (resultCode == rhs.resultCode) {
-                return true;
+    private:
+        struct State {
+            State(RowCursor&& cursor) : cursor_(std::move(cursor)) {}
+            RowCursor                                   cursor_;
+            std::vector<std::pair<int, Attribute<T>*>>  binding_;
+        };
+
+        void advance() {
+            if (state_ && state_->cursor_.next()) {
+                buildObj();
             } else {
-                return false;
+                state_.reset();
             }
         }
 
-        bool operator!=(const self_type& rhs) { return !(*this == rhs); }
+        inline void buildObj() {
+            const RowCursor& rows = state_->cursor_;
+            for (auto& bound : state_->binding_) {
+                int i = bound.first;
+                Attribute<T>* attr = bound.second;
+                switch (attr->type_) {
+                case SQLITE_INTEGER:
+                    attr->setInteger(it, rows.getInteger(i));
+                    break;
+                case SQLITE_FLOAT:
+                    attr->setFloat(it, rows.getFloat(i));
+                    break;
+                case SQLITE_TEXT: {
+                    StringRef text = rows.getText(i);
+                    attr->setText(it, text.data(), text.size());
+                    break;
+                }
+                default: {
+                    std::stringstream typeStr;
+                    typeStr << "No case for " << attr->type_;
+                    throw std::logic_error(typeStr.str());
+                }
+                }
+            }
+        }
 
-    private:
         T it;
-        int resultCode;
-        sqlite3_stmt* stmt;
+        std::shared_ptr<State> state_;
     };
 
+    // Iterate over the rows of sql, building a T from each. Result columns
+    // are matched to T's columns by name.
+    template<typename T>
+    inline Iterator<T> query(const string& sql) {
+        return Iterator<T>(RowCursor(db_, sql));
+    }
+
+    // Iterate over all rows of T's table, optionally restricted by an SQL
+    // condition, e.g. select<Hsp>("WHERE query_id = 42")
+    template<typename T>
+    inline Iterator<T> select(const string& condition = "") {
+        const Table<T>& tbl = T::table();
+        std::stringstream statementString;
+        statementString << "SELECT ";
+        for (size_t i = 0; i < tbl.column_.size(); ++i) {
+            statementString << (i ? "," : "") << tbl.column_[i].name_;
+        }
+        statementString << " FROM " << tbl.name_ << ' ' << condition << ';';
+        return query<T>(statementString.str());
+    }
+
+    template<typename T>
+    inline Iterator<T> end() {
+        return Iterator<T>();
+    }
+
+    // Row cursor over the result of sql
+    inline RowCursor cursor(const string& sql) {
+        return RowCursor(db_, sql);
+    }
+
     // Default constructor
     SqliteDB()
     {
@@ -357,8 +633,10 @@ public:
         db_ = nullptr;
     }
 
-    // Open an existing database with read/write access
-    SqliteDB(const string& dbName) : dbName_(dbName), db_(nullptr)
+    // Open an existing database with read/write access. An exclusive
+    // connection holds the lock until it is closed; otherwise the lock is
+    // only taken per transaction, waiting up to a minute for other writers.
+    SqliteDB(const string& dbName, bool exclusive = true) : dbName_(dbName), db_(nullptr)
     {
         int rc;
         rc = sqlite3_open_v2(dbName.c_str(), &db_, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, nullptr);
@@ -368,6 +646,10 @@ public:
             throw std::logic_error(string("Cannot open database ") + dbName +
                                    " because of " + sqlite3_errmsg(db_));
         }
+        if (!exclusive) {
+            sqlite3_busy_timeout(db_, 60000);
+            return;
+        }
         sqlite3_busy_timeout(db_, 1000);
         char* errorMessage;
         string sql{"PRAGMA locking_mode = EXCLUSIVE; BEGIN EXCLUSIVE; COMMIT;"};
@@ -396,43 +678,81 @@ public:
             throw std::logic_error(string("Can't open database ") + dbName +
                                    " because of " + sqlite3_errmsg(db_));
         }
-        char* errorMessage;
-        string sql{"PRAGMA locking_mode = EXCLUSIVE; BEGIN EXCLUSIVE; COMMIT;"};
-        rc = sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &errorMessage);
-        if (rc != SQLITE_OK) {
-            if (errorMessage != nullptr) {
-                throw std::logic_error(string("SQL error ") + errorMessage);
-            }
+        lockExclusive();
+        applySchema(schema);
+        //cout << "Db locked: " << this << endl;
+
+    }
+
+    // Create a new database applying schema in memory. It is written to
+    // dbName by persist(); until then dbName is not touched.
+    SqliteDB(const string& dbName, const string& schema, bool inMemory)
+        : dbName_(dbName), db_(nullptr), in_memory_(inMemory)
+    {
+        if (!inMemory) {
+            SqliteDB onDisk(dbName, schema);
+            std::swap(db_, onDisk.db_);
+            return;
         }
-        vector<string> statementStrings = split_string(schema, ";\n", false);
-        for (auto& stmtStr : statementStrings)
-        {
-            sqlite3_stmt* stmt = nullptr;
-            int state = sqlite3_prepare_v2(db_, stmtStr.c_str(), stmtStr.size(), &stmt, nullptr);
-            if (state != SQLITE_OK) {
-                throw std::logic_error(string("Statement: \"") + stmtStr + "\" failed with error:\"" +
-                                       sqlite3_errmsg(db_) + "\"");
-            }
-            if (sqlite3_step(stmt) != SQLITE_DONE) {
-                throw std::logic_error(string("Statment:\"") + stmtStr + "\" failed with error:\"" +
-                                       sqlite3_errmsg(db_) + "\"");
-            }
+        if (sqlite3_open_v2(":memory:", &db_, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, nullptr)) {
+            throw std::logic_error(string("Can't open in-memory database for ") + dbName +
+                                   " because of " + sqlite3_errmsg(db_));
         }
-        //cout << "Db locked: " << this << endl;
+        applySchema(schema);
+    }
 
+    bool inMemory() const { return in_memory_; }
+
+    // Bytes the database occupies; for an in-memory database, roughly the
+    // memory it holds
+    sqlite3_int64 size() {
+        auto pages = cursor("PRAGMA page_count;");
+        auto pageSize = cursor("PRAGMA page_size;");
+        pages.next();
+        pageSize.next();
+        return pages.getInteger(0) * pageSize.getInteger(0);
+    }
+
+    // Write an in-memory database to dbName in one pass with the backup
+    // API and continue on the file from then on. Does nothing for
+    // databases on disk. Must not be called inside a transaction.
+    void persist() {
+        if (!in_memory_) {
+            return;
+        }
+        sqlite3* file = nullptr;
+        int rc = sqlite3_open_v2(dbName_.c_str(), &file,
+                                 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, nullptr);
+        sqlite3_backup* backup = rc == SQLITE_OK ? sqlite3_backup_init(file, "main", db_, "main")
+                                                 : nullptr;
+        if (backup) {
+            rc = sqlite3_backup_step(backup, -1);
+            sqlite3_backup_finish(backup);
+        }
+        if (!backup || rc != SQLITE_DONE) {
+            string message = sqlite3_errmsg(file);
+            sqlite3_close(file);
+            throw std::logic_error(string("Cannot write database ") + dbName_ +
+                                   " because of " + message);
+        }
+        sqlite3_close(db_);
+        db_ = file;
+        in_memory_ = false;
+        lockExclusive();
     }
 
     ~SqliteDB() {
+        checkpointer_.reset();
         sqlite3_close(db_);
         //cout << "SqliteDB destructed: " << this << endl;
     }
 
     template<typename S>
-    inline static const string prepareStatment() {
+    inline static const string prepareStatment(const string& verb = "INSERT") {
         //cout << "Entering \"prepareStatment()\"" << endl;
         const Table<S>& tbl = S::table();
         std::stringstream statementString;
-        statementString << "INSERT INTO ";
+        statementString << verb << " INTO ";
         statementString << tbl.name_ << "(";
         size_t ncol = tbl.column_.size() - 1;
         for (size_t i = 0; i < ncol; ++i) {
@@ -454,22 +774,30 @@ public:
         }
     }
 
+    // Insert the objects in [start, end) into S's table; verb may be e.g.
+    // "INSERT OR IGNORE" to skip rows whose key already exists. Runs in
+    // its own transaction unless one is open already.
     template<typename S, typename It>
-    inline bool insert(It start, It end) {
+    inline bool insert(It start, It end, const string& verb = "INSERT") {
         //cout << "Entering \"insert(It start, It end)\"" << endl;
         Table<S>& tbl = S::table();
-        const string statementString(prepareStatment<S>());
+        const string statementString(prepareStatment<S>(verb));
         sqlite3_stmt* stmt;
         char* errorMessage;
+        bool own_transaction = sqlite3_get_autocommit(db_) != 0;
         //cout << "BEGIN TRANSACTION" << endl;
-        sqlite3_exec(db_, "BEGIN TRANSACTION", nullptr, nullptr, &errorMessage);
+        if (own_transaction) {
+            sqlite3_exec(db_, "BEGIN TRANSACTION", nullptr, nullptr, &errorMessage);
+        }
         sqlite3_prepare_v2(db_, statementString.c_str(), statementString.size(), &stmt, nullptr);
         std::for_each(start, end, [this, &stmt, &statementString, &tbl] (S& it) {
             addParameter(it, tbl, stmt);
             step(stmt, statementString);
             sqlite3_reset(stmt);
         });
-        sqlite3_exec(db_, "COMMIT TRANSACTION", nullptr, nullptr, &errorMessage);
+        if (own_transaction) {
+            sqlite3_exec(db_, "COMMIT TRANSACTION", nullptr, nullptr, &errorMessage);
+        }
         //cout << "COMMIT TRANSACTION" << std::endl;
         if (sqlite3_finalize(stmt) != SQLITE_OK) {
             throw std::logic_error(string("Insert Statment: \"") + statementString +
@@ -479,7 +807,115 @@ public:
         return true;
     }
 
-    inline unsigned int max_row(const string& what, const string& table) {
+    // Insert row into S's table through stmt, a cursor on
+    // prepareStatment<S>(verb); for rows that are not in one container.
+    // The caller runs the transaction.
+    template<typename S>
+    inline void insertRow(RowCursor& stmt, S& row) {
+        addParameter(row, S::table(), stmt.statement());
+        stmt.next();
+        sqlite3_reset(stmt.statement());
+    }
+
+    // Run one or more SQL statements that do not return rows
+    inline void exec(const string& sql) {
+        char* errorMessage = nullptr;
+        int rc = sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &errorMessage);
+        if (rc != SQLITE_OK) {
+            string message = errorMessage != nullptr ? errorMessage : sqlite3_errmsg(db_);
+            sqlite3_free(errorMessage);
+            throw std::logic_error(string("Statement: \"") + sql +
+                                   "\" failed with error: \"" + message + "\"");
+        }
+    }
+
+    // Add the columns of T's table that the database table lacks, so
+    // that a database written by an older version can be appended to
+    template<typename T>
+    inline void addMissingColumns() {
+        const Table<T>& tbl = T::table();
+        vector<string> present;
+        RowCursor info(db_, "PRAGMA table_info(" + tbl.name_ + ");");
+        int name = info.column("name");
+        while (info.next()) {
+            present.push_back(info.getText(name).str());
+        }
+        for (auto& col : tbl.column_) {
+            if (std::find(present.begin(), present.end(), col.name_) != present.end()) {
+                continue;
+            }
+            string type = col.attr_->type_ == SQLITE_INTEGER ? "INTEGER" :
+                          col.attr_->type_ == SQLITE_FLOAT ? "FLOAT" : "TEXT";
+            exec("ALTER TABLE " + tbl.name_ + " ADD COLUMN " + col.name_ + " " + type + ";");
+        }
+    }
+
+    // Let other connections read committed batches while this one writes:
+    // WAL journaling and normal locking. The WAL is checkpointed by a
+    // WalCheckpointer once it reaches walLimit bytes or every interval
+    // seconds, never by the committing connection.
+    inline void setLive(sqlite3_int64 walLimit, int interval) {
+        exec("PRAGMA locking_mode = NORMAL;");
+        // an exclusive lock is only given up by the next access
+        exec("SELECT count(*) FROM sqlite_master;");
+        {
+            auto mode = cursor("PRAGMA journal_mode = WAL;");
+            if (!mode.next() || mode.getText(0) != "wal") {
+                throw std::logic_error("Cannot switch database " + dbName_ + " to WAL journaling");
+            }
+        }
+        exec("PRAGMA synchronous = NORMAL;");
+        sqlite3_busy_timeout(db_, 60000);
+        auto pageSize = cursor("PRAGMA page_size;");
+        pageSize.next();
+        checkpointer_.reset(new WalCheckpointer(dbName_, walLimit / pageSize.getInteger(0), interval));
+        // replaces SQLite's automatic checkpoints
+        sqlite3_wal_hook(db_, &WalCheckpointer::onCommit, checkpointer_.get());
+    }
+
+    // Whether no transaction is open
+    inline bool autocommit() const { return sqlite3_get_autocommit(db_) != 0; }
+
+    // Roll back the open transaction, if any; errors are ignored, so that
+    // this can be used while handling another one
+    inline void rollback() {
+        if (!sqlite3_get_autocommit(db_)) {
+            sqlite3_exec(db_, "ROLLBACK;", nullptr, nullptr, nullptr);
+        }
+    }
+
+    // Reserve n consecutive ids of table, whose primary key is key, and
+    // return the first. Ids are handed out by the id_allocator table and
+    // never below max(key) + 1, so rows written without reserving are
+    // respected too. Call inside a write transaction (BEGIN IMMEDIATE) or
+    // one is opened for the reservation.
+    inline RowId reserveIds(const string& table, const string& key, RowId n) {
+        bool own_transaction = sqlite3_get_autocommit(db_) != 0;
+        if (own_transaction) {
+            exec("BEGIN IMMEDIATE;");
+        }
+        RowId first;
+        try {
+            RowCursor next(db_, "SELECT max(coalesce((SELECT next_id FROM id_allocator WHERE name = '" +
+                                table + "'), 1), (SELECT coalesce(max(" + key + "), 0) + 1 FROM " +
+                                table + "));");
+            next.next();
+            first = next.getInteger(0);
+            exec("INSERT OR REPLACE INTO id_allocator (name, next_id) VALUES ('" + table + "', " +
+                 std::to_string(first + n) + ");");
+        } catch (...) {
+            if (own_transaction) {
+                rollback();
+            }
+            throw;
+        }
+        if (own_transaction) {
+            exec("COMMIT;");
+        }
+        return first;
+    }
+
+    inline RowId max_row(const string& what, const string& table) {
         //cout << "Entering \"max_row(const std::string& what, const string& table)\"" << endl;
         string statementString("SELECT max(" + what + ") FROM " + table + ";");
         sqlite3_stmt* stmt = nullptr;
@@ -489,7 +925,7 @@ public:
                                    "\" failed with error: \"" + sqlite3_errmsg(db_) + "\"");
         }
         sqlite3_step(stmt);
-        int maxrow = sqlite3_column_int(stmt, 0);
+        RowId maxrow = sqlite3_column_int64(stmt, 0);
         //cout << "Maximum " << table << " id: " << maxrow << endl;
         sqlite3_finalize(stmt);
         return maxrow;
@@ -504,7 +940,7 @@ private:
         {
             switch(col.attr_->type_) {
             case SQLITE_INTEGER: {
-                sqlite3_bind_int(stmt, i++, col.attr_->getInteger(t));
+                sqlite3_bind_int64(stmt, i++, col.attr_->getInteger(t));
                 break;
             }
             case SQLITE_FLOAT: {
@@ -512,8 +948,9 @@ private:
                 break;
             }
             case SQLITE_TEXT: {
+                // getText returns a temporary, so sqlite has to take a copy
                 const std::string Text = col.attr_->getText(t);
-                sqlite3_bind_text(stmt, i++, Text.c_str(), Text.size(), SQLITE_STATIC);
+                sqlite3_bind_text(stmt, i++, Text.c_str(), Text.size(), SQLITE_TRANSIENT);
                 break;
             }
             default: {
@@ -525,8 +962,42 @@ private:
         });
     }
 
+    // hold the file lock until the connection is closed
+    void lockExclusive() {
+        char* errorMessage;
+        string sql{"PRAGMA locking_mode = EXCLUSIVE; BEGIN EXCLUSIVE; COMMIT;"};
+        int rc = sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &errorMessage);
+        if (rc != SQLITE_OK) {
+            if (errorMessage != nullptr) {
+                throw std::logic_error(string("SQL error ") + errorMessage);
+            }
+        }
+    }
+
+    void applySchema(const string& schema) {
+        vector<string> statementStrings = split_string(schema, ";\n", false);
+        for (auto& stmtStr : statementStrings)
+        {
+            sqlite3_stmt* stmt = nullptr;
+            int state = sqlite3_prepare_v2(db_, stmtStr.c_str(), stmtStr.size(), &stmt, nullptr);
+            if (state != SQLITE_OK) {
+                sqlite3_finalize(stmt);
+                throw std::logic_error(string("Statement: \"") + stmtStr + "\" failed with error:\"" +
+                                       sqlite3_errmsg(db_) + "\"");
+            }
+            state = sqlite3_step(stmt);
+            sqlite3_finalize(stmt);
+            if (state != SQLITE_DONE) {
+                throw std::logic_error(string("Statment:\"") + stmtStr + "\" failed with error:\"" +
+                                       sqlite3_errmsg(db_) + "\"");
+            }
+        }
+    }
+
     string dbName_;
     sqlite3* db_;
+    bool in_memory_ = false;
+    std::unique_ptr<WalCheckpointer> checkpointer_;
 
 };
 
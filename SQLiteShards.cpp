@@ -0,0 +1,247 @@
+#include "SQLiteShards.hpp"
+
+// SqliteShard
+
+SqliteShard::SqliteShard(const string& dbName, const string& dbSchema,
+                         size_t max_queued)
+    : dbName_(dbName),
+      db_(dbName, dbSchema),
+      max_queued_(max_queued),
+      done_(false)
+{
+    writer_ = std::thread(&SqliteShard::run, this);
+}
+
+SqliteShard::~SqliteShard()
+{
+    try {
+        finish();
+    } catch (const std::logic_error& toCatch) {
+        cout << toCatch.what() << endl;
+    }
+}
+
+void SqliteShard::push(std::vector<BlastQuery>&& batch)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] { return queue_.size() < max_queued_ || error_; });
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+    queue_.push_back(std::move(batch));
+    not_empty_.notify_one();
+}
+
+void SqliteShard::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+    }
+    not_empty_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+// the writer thread: take batches off the queue until finish() is called
+// and the queue is drained
+void SqliteShard::run()
+{
+    while (true) {
+        std::vector<BlastQuery> batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_empty_.wait(lock, [this] { return !queue_.empty() || done_; });
+            if (queue_.empty()) {
+                return;
+            }
+            batch = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        not_full_.notify_one();
+        try {
+            insert_batch(db_, batch, subjects_written_);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = std::current_exception();
+            queue_.clear();
+            not_full_.notify_all();
+            return;
+        }
+    }
+}
+
+
+// ShardedSqliteDB
+
+ShardedSqliteDB::ShardedSqliteDB(const string& dbName, const string& dbSchema,
+                                 unsigned int nshards,
+                                 ShardPartition partition,
+                                 unsigned int range_size)
+    : partition_(partition),
+      range_size_(range_size > 0 ? range_size : 1)
+{
+    if (nshards == 0) {
+        throw std::logic_error("Number of shards must be at least 1");
+    }
+    for (unsigned int k = 0; k < nshards; ++k) {
+        shards_.emplace_back(new SqliteShard(shardName(dbName, k), dbSchema));
+    }
+}
+
+string ShardedSqliteDB::shardName(const string& dbName, unsigned int k)
+{
+    const string ext(".db");
+    string base = dbName;
+    if (base.size() > ext.size() &&
+            base.compare(base.size() - ext.size(), ext.size(), ext) == 0) {
+        base.erase(base.size() - ext.size());
+    }
+    return base + ".shard" + std::to_string(k) + ext;
+}
+
+size_t ShardedSqliteDB::shardOf(BlastQuery& query) const
+{
+    if (partition_ == ShardPartition::Hash) {
+        // 64-bit FNV-1a
+        unsigned long long h = 14695981039346656037ULL;
+        for (unsigned char c : query.getQueryDef()) {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        return h % shards_.size();
+    }
+    return ((query.getID() - 1) / range_size_) % shards_.size();
+}
+
+void ShardedSqliteDB::dispatch(std::vector<BlastQuery>& batch)
+{
+    std::vector<std::vector<BlastQuery>> parts(shards_.size());
+    for (auto& query : batch) {
+        parts[shardOf(query)].push_back(std::move(query));
+    }
+    batch.clear();
+    for (size_t k = 0; k < parts.size(); ++k) {
+        if (!parts[k].empty()) {
+            shards_[k]->push(std::move(parts[k]));
+        }
+    }
+}
+
+void ShardedSqliteDB::onBatch(std::vector<BlastQuery>& batch)
+{
+    count_batch(batch, dispatched_);
+    dispatch(batch);
+    cout << "Processed " << dispatched_.queries << " queries, " << dispatched_.hits
+         << " hits, and " << dispatched_.hsps << " hsps." << endl;
+}
+
+void ShardedSqliteDB::finish()
+{
+    for (auto& shard : shards_) {
+        shard->finish();
+    }
+}
+
+
+// Merging
+
+// A table copied from the shards
+struct ShardTable
+{
+    const char* name;
+    const char* key;    // primary key, rows are inserted in its order
+    const char* verb;   // subjects hit in several shards are stored by each
+};
+
+// tables in foreign key order
+static const std::vector<ShardTable> SHARD_TABLES = {
+    { "query",          "query_id",     "INSERT" },
+    { "subject",        "subject_id",   "INSERT OR IGNORE" },
+    { "hit",            "hit_id",       "INSERT" },
+    { "defline",        "subject_id, defline_num", "INSERT OR IGNORE" },
+    { "hsp",            "hsp_id",       "INSERT" },
+    { "query_summary",  "query_id",     "INSERT" }
+};
+
+// SQLite attaches at most 10 databases by default
+static const size_t MERGE_GROUP_SIZE = 8;
+
+string stored_schema(const string& dbName)
+{
+    SqliteDB db(dbName);
+    string schema;
+    auto stmts = db.cursor("SELECT sql FROM sqlite_master WHERE sql IS NOT NULL "
+                           "AND name NOT LIKE 'sqlite_%' ORDER BY rowid;");
+    while (stmts.next()) {
+        schema += stmts.getText(0).str() + ";\n";
+    }
+    return schema;
+}
+
+void merge_shards(const string& outName, const std::vector<string>& shardNames,
+                  const string& dbSchema)
+{
+    SqliteDB out(outName, dbSchema);
+    // more shards than can be attached at once are collected in temporary
+    // tables first, so that the rows are sorted across all groups
+    bool staged = shardNames.size() > MERGE_GROUP_SIZE;
+    if (staged) {
+        for (auto& table : SHARD_TABLES) {
+            out.exec(string("CREATE TEMP TABLE stage_") + table.name + " AS SELECT * FROM main." +
+                     table.name + " WHERE 0;");
+        }
+    }
+    for (size_t first = 0; first < shardNames.size(); first += MERGE_GROUP_SIZE) {
+        size_t last = std::min(first + MERGE_GROUP_SIZE, shardNames.size());
+        for (size_t k = first; k < last; ++k) {
+            // quote the file name as an SQL string literal
+            string file;
+            for (char c : shardNames[k]) {
+                file += c;
+                if (c == '\'') file += c;
+            }
+            out.exec("ATTACH DATABASE '" + file + "' AS shard" + std::to_string(k - first) + ";");
+        }
+        out.exec("BEGIN TRANSACTION;");
+        for (auto& table : SHARD_TABLES) {
+            std::stringstream sql;
+            if (staged) {
+                sql << "INSERT INTO temp.stage_" << table.name << " SELECT * FROM (";
+            } else {
+                sql << table.verb << " INTO main." << table.name << " SELECT * FROM (";
+            }
+            for (size_t k = first; k < last; ++k) {
+                if (k != first) sql << " UNION ALL ";
+                sql << "SELECT * FROM shard" << k - first << '.' << table.name;
+            }
+            sql << ")";
+            if (!staged) {
+                sql << " ORDER BY " << table.key;
+            }
+            sql << ";";
+            out.exec(sql.str());
+        }
+        out.exec("COMMIT TRANSACTION;");
+        for (size_t k = first; k < last; ++k) {
+            out.exec("DETACH DATABASE shard" + std::to_string(k - first) + ";");
+        }
+        cout << "Merged " << last << " of " << shardNames.size() << " shards." << endl;
+    }
+    if (staged) {
+        out.exec("BEGIN TRANSACTION;");
+        for (auto& table : SHARD_TABLES) {
+            out.exec(string(table.verb) + " INTO main." + table.name + " SELECT * FROM temp.stage_" +
+                     table.name + " ORDER BY " + table.key + ";");
+            out.exec(string("DROP TABLE temp.stage_") + table.name + ";");
+        }
+        out.exec("COMMIT TRANSACTION;");
+        cout << "Sorted the rows of all shards into " << outName << "." << endl;
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef SQLITESHARDS_HPP
+#define SQLITESHARDS_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+
+#include "BlastVisitor.hpp"
+
+// How queries are assigned to shards
+enum class ShardPartition
+{
+    Range,  // consecutive blocks of query_ids go round-robin to the shards
+    Hash    // FNV-1a hash of query_def, stable across runs and platforms
+};
+
+// A single shard: one SQLite file fed by its own writer thread
+class SqliteShard
+{
+public:
+    // Create a new database dbName applying dbSchema and start the writer
+    SqliteShard(const string& dbName, const string& dbSchema,
+                size_t max_queued = 4);
+
+    ~SqliteShard();
+
+    // Hand a batch over to the writer thread. Blocks while max_queued
+    // batches are still waiting, so a slow disk throttles the parser.
+    void push(std::vector<BlastQuery>&& batch);
+
+    // Write all pending batches and stop the writer thread
+    void finish();
+
+    const string& name() const { return dbName_; }
+
+private:
+    void run();
+
+    string                                  dbName_;
+    SqliteDB                                db_;
+    size_t                                  max_queued_;
+    std::deque<std::vector<BlastQuery>>     queue_;
+    std::mutex                              mutex_;
+    std::condition_variable                 not_empty_;
+    std::condition_variable                 not_full_;
+    bool                                    done_;
+    std::exception_ptr                      error_;
+    std::thread                             writer_;
+    std::unordered_set<RowId>               subjects_written_;  // by the writer
+};
+
+
+// Distributes query batches over N shards, each written in parallel
+class ShardedSqliteDB : public BlastVisitor
+{
+public:
+    // Create N new shard databases named after dbName (see shardName).
+    // With ShardPartition::Range, blocks of range_size consecutive
+    // query_ids are assigned to the shards in turn.
+    ShardedSqliteDB(const string& dbName, const string& dbSchema,
+                    unsigned int nshards,
+                    ShardPartition partition = ShardPartition::Range,
+                    unsigned int range_size = 1000);
+
+    // Split batch over the shards and hand the parts to the writers;
+    // batch is left empty
+    void dispatch(std::vector<BlastQuery>& batch);
+
+    // Wait until all shards have written their pending batches
+    void finish();
+
+    // BlastVisitor interface: dispatch each batch, finish at the end
+    void onBatch(std::vector<BlastQuery>& batch);
+    void onFinish(const BlastCounters& counters) { finish(); }
+
+    size_t size() const { return shards_.size(); }
+
+    // "<base>.db" -> "<base>.shard<k>.db"
+    static string shardName(const string& dbName, unsigned int k);
+
+private:
+    size_t shardOf(BlastQuery& query) const;
+
+    std::vector<std::unique_ptr<SqliteShard>>   shards_;
+    ShardPartition                              partition_;
+    unsigned int                                range_size_;
+    BlastCounters                               dispatched_;
+};
+
+
+// Merge shard databases into a new database outName created with
+// dbSchema. Every table's rows are inserted in primary key order across
+// all shards; shards are attached in groups, which are collected in
+// temporary tables when there is more than one.
+void merge_shards(const string& outName, const std::vector<string>& shardNames,
+                  const string& dbSchema);
+
+// The statements that created the tables, indexes, and views of the
+// database dbName, e.g. to create a merged database like its shards
+string stored_schema(const string& dbName);
+
+#endif // SQLITESHARDS_HPP
@@ -0,0 +1,165 @@
+#include "SQLiteVisitor.hpp"
+
+SqliteVisitor::SqliteVisitor(const string& dbName, AppendMode mode)
+    : db_(dbName, mode == AppendMode::Exclusive),
+      append_(true),
+      mode_(mode)
+{
+    // other appenders may be upgrading the schema at the same time
+    db_.exec("BEGIN IMMEDIATE;");
+    bool inline_definitions = false;
+    {
+        auto columns = db_.cursor("PRAGMA table_info(hit);");
+        int name = columns.column("name");
+        while (columns.next()) {
+            inline_definitions |= columns.getText(name) == "definition";
+        }
+    }
+    if (inline_definitions) {
+        db_.exec("ROLLBACK;");
+        throw std::logic_error("Database \"" + dbName + "\" stores hit definitions " +
+                               "inline and cannot be appended to; parse into a new database");
+    }
+    db_.exec(QUERY_SUMMARY_SCHEMA);
+    db_.exec(DEFLINE_SCHEMA);
+    db_.exec(ID_ALLOCATOR_SCHEMA);
+    create_ingest_registry(db_);
+    db_.addMissingColumns<BlastHit>();
+    db_.addMissingColumns<BlastSubject>();
+    db_.addMissingColumns<Hsp>();
+    db_.exec("COMMIT;");
+}
+
+void SqliteVisitor::onStart(BlastCounters& counters, SubjectInterner& subjects)
+{
+    // concurrent appenders keep the parser's ids, counted from 0, and
+    // replace them per batch
+    if (append_ && mode_ == AppendMode::Exclusive) {
+        auto stored = db_.cursor("SELECT subject_id, accession, gene_id FROM subject;");
+        while (stored.next()) {
+            RowId id = stored.getInteger(0);
+            subjects.seed(stored.getText(1).str(), stored.getText(2).str(), id);
+            subjects_written_.insert(id);
+        }
+        counters.subjects = db_.max_row("subject_id", "subject");
+        counters.queries = db_.max_row("query_id", "query");
+        counters.hits = db_.max_row("hit_id", "hit");
+        counters.hsps = db_.max_row("hsp_id", "hsp");
+        //std::cout << "Max. query = " << counters.queries << "\n";
+        //std::cout << "Max. hit = " << counters.hits << "\n";
+        //std::cout << "Max. hsp = " << counters.hsps << "\n";
+    }
+    written_ = counters;
+}
+
+// dump query, hit, and hsp lists to SQlite DB
+void SqliteVisitor::onBatch(std::vector<BlastQuery>& batch)
+{
+    BlastCounters size;
+    count_batch(batch, size);
+    // a batch is written in one transaction together with its record in
+    // the ingest registry; concurrent appenders hold the write lock only
+    // for that
+    db_.exec("BEGIN IMMEDIATE;");
+    try {
+        BlastCounters first;
+        if (mode_ == AppendMode::Concurrent) {
+            first = reserve_ids(batch);
+        } else {
+            first.queries = written_.queries + 1;
+            first.hits = written_.hits + 1;
+            first.hsps = written_.hsps + 1;
+        }
+        insert_batch(db_, batch, subjects_written_);
+        registry_.addBatch(db_, first, size);
+        db_.exec("COMMIT;");
+    } catch (...) {
+        db_.rollback();
+        throw;
+    }
+    count_batch(batch, written_);
+    cout << "Processed " << written_.queries << " queries, " << written_.hits
+         << " hits, and " << written_.hsps << " hsps." << endl;
+    if (db_.inMemory() && memory_limit_ > 0 && db_.size() > memory_limit_) {
+        cout << "In-memory database exceeds " << (memory_limit_ >> 20)
+             << " MiB; continuing on disk." << endl;
+        db_.persist();
+    }
+}
+
+void SqliteVisitor::onFinish(const BlastCounters& counters)
+{
+    registry_.finish(db_);
+    if (db_.inMemory()) {
+        cout << "Writing " << (db_.size() >> 20) << " MiB database to disk." << endl;
+        db_.persist();
+    }
+}
+
+BlastCounters SqliteVisitor::reserve_ids(std::vector<BlastQuery>& batch)
+{
+    // the parser numbered the batch consecutively after written_, so each
+    // kind of id is moved by a single offset
+    BlastCounters size, first;
+    count_batch(batch, size);
+    first.queries = db_.reserveIds("query", "query_id", size.queries);
+    first.hits = db_.reserveIds("hit", "hit_id", size.hits);
+    first.hsps = db_.reserveIds("hsp", "hsp_id", size.hsps);
+    RowId query_offset = first.queries - (written_.queries + 1);
+    RowId hit_offset = first.hits - (written_.hits + 1);
+    RowId hsp_offset = first.hsps - (written_.hsps + 1);
+
+    // subjects new to this appender are looked up among the stored ones,
+    // which other appenders may have written meanwhile
+    std::vector<BlastHit*> unseen;
+    {
+        auto stored = db_.cursor("SELECT subject_id FROM subject WHERE accession = ?1 AND gene_id = ?2;");
+        for (auto& query : batch) {
+            for (auto& hit : query.getHit()) {
+                if (subject_ids_.count(hit.getSubjectID())) {
+                    continue;
+                }
+                string accession = hit.getHitAccession();
+                string gene_id = hit.getHitId();
+                sqlite3_bind_text(stored.statement(), 1, accession.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stored.statement(), 2, gene_id.c_str(), -1, SQLITE_TRANSIENT);
+                if (stored.next()) {
+                    RowId id = stored.getInteger(0);
+                    subject_ids_[hit.getSubjectID()] = id;
+                    subjects_written_.insert(id);
+                } else {
+                    // a placeholder until ids are reserved below
+                    subject_ids_[hit.getSubjectID()] = 0;
+                    unseen.push_back(&hit);
+                }
+                sqlite3_reset(stored.statement());
+            }
+        }
+    }
+    if (!unseen.empty()) {
+        RowId next = db_.reserveIds("subject", "subject_id", unseen.size());
+        for (auto hit : unseen) {
+            subject_ids_[hit->getSubjectID()] = next++;
+        }
+    }
+
+    for (auto& query : batch) {
+        query.setID(query.getID() + query_offset);
+        QuerySummary& summary = query.getSummary();
+        summary.setQueryID(query.getID());
+        if (summary.getBestHitID() != 0) {
+            summary.setBestHitID(summary.getBestHitID() + hit_offset);
+        }
+        for (auto& hit : query.getHit()) {
+            hit.setID(hit.getID() + hit_offset);
+            hit.setQueryID(query.getID());
+            hit.setSubjectID(subject_ids_[hit.getSubjectID()]);
+            for (auto& hsp : hit.getHsp()) {
+                hsp.setID(hsp.getID() + hsp_offset);
+                hsp.setHitID(hit.getID());
+                hsp.setQueryID(query.getID());
+            }
+        }
+    }
+    return first;
+}
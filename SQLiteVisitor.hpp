@@ -0,0 +1,71 @@
+#ifndef SQLITEVISITOR_HPP
+#define SQLITEVISITOR_HPP
+
+#include "BlastVisitor.hpp"
+#include "IngestRegistry.hpp"
+
+// How an existing database is appended to
+enum class AppendMode
+{
+    Exclusive,  // lock the database for the whole run; ids continue after max(id)
+    Concurrent  // lock only while a batch is committed; ids are reserved per batch
+};
+
+// Writes every batch of queries, hits, and hsps into a SQLite database
+class SqliteVisitor : public BlastVisitor
+{
+public:
+    // Create a new database dbName applying dbSchema. With inMemory the
+    // database is built in memory and written to dbName when parsing
+    // finishes, or as soon as it grows beyond memoryLimit bytes (if > 0),
+    // after which it continues on disk.
+    SqliteVisitor(const string& dbName, const string& dbSchema,
+                  bool inMemory = false, sqlite3_int64 memoryLimit = 0)
+        : db_(dbName, dbSchema, inMemory),
+          append_(false),
+          mode_(AppendMode::Exclusive),
+          memory_limit_(memoryLimit)
+    {
+    }
+
+    // Open an existing database dbName and append to it. Throws
+    // std::logic_error if it predates the subject table. With
+    // AppendMode::Concurrent, several processes may append at once.
+    SqliteVisitor(const string& dbName, AppendMode mode = AppendMode::Exclusive);
+
+    // when appending exclusively, continue after the largest ids in the
+    // database and reuse the subjects already stored
+    void onStart(BlastCounters& counters, SubjectInterner& subjects);
+
+    void onBatch(std::vector<BlastQuery>& batch);
+
+    // mark a claimed input as complete and write an in-memory database to
+    // its file
+    void onFinish(const BlastCounters& counters);
+
+    // Record the rows written in the ingested_files table, for the file at
+    // path with fingerprint (see IngestRegistry::claim)
+    IngestClaim claimInput(const string& fingerprint, const string& path, IngestPolicy policy,
+                           IngestState& found, BlastCounters& removed) {
+        return registry_.claim(db_, fingerprint, path, policy, found, removed);
+    }
+
+    SqliteDB& db() { return db_; }
+
+protected:
+    // replace the parser's ids in batch by ids reserved in the database,
+    // and its subject ids by those of the stored subjects; returns the
+    // first ids reserved
+    BlastCounters reserve_ids(std::vector<BlastQuery>& batch);
+
+    SqliteDB        db_;
+    bool            append_;
+    AppendMode      mode_;
+    sqlite3_int64   memory_limit_ = 0;
+    std::unordered_map<RowId, RowId> subject_ids_;  // parser's -> stored ids
+    BlastCounters   written_;
+    std::unordered_set<RowId> subjects_written_;
+    IngestRegistry  registry_;
+};
+
+#endif // SQLITEVISITOR_HPP
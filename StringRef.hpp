@@ -0,0 +1,63 @@
+#ifndef STRINGREF_HPP
+#define STRINGREF_HPP
+
+#include <cstring>
+#include <string>
+#include <ostream>
+
+// A non-owning view of a character range; the referenced memory must
+// outlive the StringRef.
+class StringRef
+{
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    StringRef() : data_(nullptr), size_(0) {}
+    StringRef(const char* data, size_t size) : data_(data), size_(size) {}
+    StringRef(const char* str) : data_(str), size_(str ? std::strlen(str) : 0) {}
+    StringRef(const std::string& str) : data_(str.data()), size_(str.size()) {}
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+    char operator[](size_t i) const { return data_[i]; }
+
+    // the subrange [pos, pos + n), clipped to the end
+    StringRef substr(size_t pos, size_t n = npos) const {
+        if (pos > size_) pos = size_;
+        if (n > size_ - pos) n = size_ - pos;
+        return StringRef(data_ + pos, n);
+    }
+
+    size_t find(char c, size_t pos = 0) const {
+        if (pos >= size_) return npos;
+        const void* hit = std::memchr(data_ + pos, c, size_ - pos);
+        return hit ? static_cast<const char*>(hit) - data_ : npos;
+    }
+
+    bool startsWith(StringRef prefix) const {
+        return prefix.size_ <= size_ &&
+               (prefix.size_ == 0 || std::memcmp(data_, prefix.data_, prefix.size_) == 0);
+    }
+
+    std::string str() const { return std::string(data_, size_); }
+
+    friend bool operator==(StringRef a, StringRef b) {
+        return a.size_ == b.size_ &&
+               (a.size_ == 0 || std::memcmp(a.data_, b.data_, a.size_) == 0);
+    }
+    friend bool operator!=(StringRef a, StringRef b) { return !(a == b); }
+
+    friend std::ostream& operator<<(std::ostream& out, StringRef s) {
+        return out.write(s.data_, s.size_);
+    }
+
+private:
+    const char* data_;
+    size_t      size_;
+};
+
+#endif // STRINGREF_HPP
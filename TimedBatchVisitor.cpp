@@ -0,0 +1,87 @@
+#include "TimedBatchVisitor.hpp"
+
+TimedBatchVisitor::TimedBatchVisitor(BlastVisitor& visitor, size_t batch_size,
+                                     std::chrono::milliseconds max_latency)
+    : visitor_(visitor),
+      batch_size_(batch_size > 0 ? batch_size : 1),
+      max_latency_(max_latency),
+      done_(false)
+{
+    writer_ = std::thread(&TimedBatchVisitor::run, this);
+}
+
+TimedBatchVisitor::~TimedBatchVisitor()
+{
+    stop();
+}
+
+void TimedBatchVisitor::onBatch(std::vector<BlastQuery>& batch)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    taken_.wait(lock, [this] { return buffer_.size() < batch_size_ || error_; });
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+    if (buffer_.empty()) {
+        oldest_ = Clock::now();
+    }
+    for (auto& query : batch) {
+        buffer_.push_back(std::move(query));
+    }
+    batch.clear();
+    arrived_.notify_one();
+}
+
+void TimedBatchVisitor::onFinish(const BlastCounters& counters)
+{
+    stop();
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+    visitor_.onFinish(counters);
+}
+
+void TimedBatchVisitor::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+    }
+    arrived_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+}
+
+// the writer thread: wait until the buffer is full, its oldest query is
+// due, or parsing has ended, then pass the buffer on
+void TimedBatchVisitor::run()
+{
+    std::vector<BlastQuery> batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        arrived_.wait(lock, [this] { return !buffer_.empty() || done_; });
+        if (buffer_.empty()) {
+            return;
+        }
+        arrived_.wait_until(lock, oldest_ + max_latency_, [this] {
+            return buffer_.size() >= batch_size_ || done_;
+        });
+        batch.swap(buffer_);
+        taken_.notify_one();
+        lock.unlock();
+        try {
+            visitor_.onBatch(batch);
+        } catch (...) {
+            lock.lock();
+            error_ = std::current_exception();
+            buffer_.clear();
+            taken_.notify_all();
+            return;
+        }
+        batch.clear();
+        lock.lock();
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef TIMEDBATCHVISITOR_HPP
+#define TIMEDBATCHVISITOR_HPP
+
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include "BlastVisitor.hpp"
+
+// Collects queries into batches for another visitor and hands a batch on
+// once it holds batch_size queries or its oldest query has waited
+// max_latency, whichever comes first. Batches are passed on by a thread of
+// its own, so the age limit holds even while the parser waits for slow
+// input. Parse with reset_at = 1 so that every query arrives at once.
+//
+// The wrapped visitor receives onStart, onHsp, onHit, and onQuery on the
+// parser's thread as usual, and onBatch on the writer thread; onFinish
+// once all batches are written.
+class TimedBatchVisitor : public BlastVisitor
+{
+public:
+    TimedBatchVisitor(BlastVisitor& visitor, size_t batch_size,
+                      std::chrono::milliseconds max_latency);
+
+    ~TimedBatchVisitor();
+
+    void onStart(BlastCounters& counters, SubjectInterner& subjects) {
+        visitor_.onStart(counters, subjects);
+    }
+    void onHsp(Hsp& hsp) { visitor_.onHsp(hsp); }
+    void onHit(BlastHit& hit) { visitor_.onHit(hit); }
+    void onQuery(BlastQuery& query) { visitor_.onQuery(query); }
+
+    // Buffer the queries of batch, leaving it empty. Blocks while a full
+    // batch is still waiting for the writer.
+    void onBatch(std::vector<BlastQuery>& batch);
+
+    // Write what is buffered, stop the writer, and finish the wrapped
+    // visitor. Rethrows an error of the writer.
+    void onFinish(const BlastCounters& counters);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    void run();
+    void stop();
+
+    BlastVisitor&               visitor_;
+    size_t                      batch_size_;
+    std::chrono::milliseconds   max_latency_;
+    std::vector<BlastQuery>     buffer_;
+    Clock::time_point           oldest_;    // arrival of buffer_.front()
+    std::mutex                  mutex_;
+    std::condition_variable     arrived_;
+    std::condition_variable     taken_;
+    bool                        done_;
+    std::exception_ptr          error_;
+    std::thread                 writer_;
+};
+
+#endif // TIMEDBATCHVISITOR_HPP
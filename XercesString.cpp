@@ -0,0 +1,37 @@
+#include "XercesString.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void toNative (const XMLCh* str, size_t len, std::string& out)
+{
+    out.resize (len);
+    char* dst = &out[0];
+    size_t i = 0;
+#ifdef __SSE2__
+    // narrow 16 characters at a time while none of them is above 0x7f;
+    // packus saturates, so the check has to come first
+    const __m128i non_ascii = _mm_set1_epi16 (static_cast<short> (0xff80));
+    const __m128i zero = _mm_setzero_si128 ();
+    for (; i + 16 <= len; i += 16) {
+        __m128i lo = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (str + i));
+        __m128i hi = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (str + i + 8));
+        __m128i high_bits = _mm_and_si128 (_mm_or_si128 (lo, hi), non_ascii);
+        if (_mm_movemask_epi8 (_mm_cmpeq_epi16 (high_bits, zero)) != 0xffff) {
+            break;
+        }
+        _mm_storeu_si128 (reinterpret_cast<__m128i*> (dst + i), _mm_packus_epi16 (lo, hi));
+    }
+#endif
+    for (; i < len; ++i) {
+        if (str[i] > 0x7f) {
+            // leave everything to the transcoder, which needs a terminated string
+            XercesString terminated (str, len);
+            boost::scoped_array<char> ptr (xercesc::XMLString::transcode (terminated.c_str ()));
+            out.assign (ptr.get ());
+            return;
+        }
+        dst[i] = static_cast<char> (str[i]);
+    }
+}
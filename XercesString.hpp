@@ -1,6 +1,8 @@
 #ifndef XERCESSTRING_HPP
 #define XERCESSTRING_HPP
 
+#include <string>
+
 #include <boost/scoped_array.hpp>
 #include <xercesc/util/XMLString.hpp>
 
@@ -18,16 +20,29 @@ XercesString fromNative (const std::string& str) {
     return fromNative (str.c_str ());
 }
 
+// convert len wide characters at str to narrow characters in out, reusing
+// its storage. ASCII, which is all BLAST XML holds in practice, is narrowed
+// directly; anything else goes through the Xerces transcoder.
+void toNative (const XMLCh* str, size_t len, std::string& out);
+
+inline
+void toNative (const XercesString& str, std::string& out) {
+    toNative (str.data (), str.size (), out);
+}
+
 // convert from wide character to narrow character
 inline
 std::string toNative (const XMLCh* str) {
-    boost::scoped_array<char> ptr(xercesc::XMLString::transcode (str));
-    return std::string(ptr.get ());
+    std::string out;
+    toNative (str, xercesc::XMLString::stringLen (str), out);
+    return out;
 }
 
 inline
 std::string toNative (const XercesString& str) {
-    return toNative (str.c_str ());
+    std::string out;
+    toNative (str, out);
+    return out;
 }
 
 
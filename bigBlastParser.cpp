@@ -1,27 +1,61 @@
-#include <xercesc/sax2/XMLReaderFactory.hpp>
-#include <xercesc/util/PlatformUtils.hpp>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <stdexcept>
 
-#include "BlastSAXHandler.hpp"
+#include "BlastParser.hpp"
+#include "BlastScan.hpp"
+#include "SQLiteVisitor.hpp"
+#include "SQLiteShards.hpp"
+#include "TimedBatchVisitor.hpp"
+#include "IngestRegistry.hpp"
+#include "AlignmentWriter.hpp"
 
-using namespace xercesc;
 using std::cerr;
 using std::cout;
 using std::endl;
 
 static void show_usage(std::string name);
+static int merge_main(int argc, char *argv[]);
+static int scan_main(const BlastParseOptions& options);
+static int remove_main(int argc, char *argv[]);
 std::string replace_extension(std::string, const std::string);
+static long parse_duration_ms(const std::string&);
 bool file_exists(std::string&);
-BlastQueryContentHandler& makeBlastQueryContentHandler(bool);
 
 // set defaults
+bool scan = false;                  // only count, do not parse
 std::string xmlFile;                // must be provided
 std::string dbName("");
 bool append = false;
+bool concurrent = false;
+bool in_memory = false;
+long memory_limit = -1;             // MiB; -1: half the physical memory
+bool live = false;
+long checkpoint_mb = 64;
+int checkpoint_secs = 30;
 int max_hit = 20;
 int max_hsp = 20;
+bool max_hit_set = false;
+bool max_hsp_set = false;
+int top_hits = -1;
+int top_hsps = -1;
+BlastRank rank_by = BlastRank::BitScore;
+double signif_evalue = 1e-5;
+bool split_deflines = false;
+int sample_every = 1;
+int cull = 0;
+double cull_overlap = 50;           // percent
+std::string query_list;             // files of ids to keep; empty: all
+std::string subject_list;
+int read_buffer = 4;                // MiB
+int read_queue = 4;
 int reset_at = 1000;
+long max_batch_latency = 0;         // ms; 0: batches are only cut by reset_at
+int shards = 0;
+ShardPartition partition = ShardPartition::Range;
+std::string if_ingested = "fail";   // what to do with a file stored before
+std::string format = "sqlite";      // or 'sam', 'paf'
+std::string schema = BLAST_DB_SCHEMA;
 int checkFileName;
 char* offset;
 
@@ -38,7 +72,20 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[1]) == "merge") {
+        return merge_main(argc, argv);
+    }
+    if (std::string(argv[1]) == "remove") {
+        return remove_main(argc, argv);
+    }
+
+    int first = 1;
+    if (std::string(argv[1]) == "scan") {
+        scan = true;
+        first = 2;
+    }
+
+    for (int i = first; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "-h" || arg == "--help") {
             show_usage(argv[0]);
@@ -48,12 +95,103 @@ int main(int argc, char *argv[])
                 dbName = argv[++i];
             } else if (arg == "-a" || arg == "--append") {
                 append =true;
+            } else if (arg == "--concurrent") {
+                concurrent = true;
+            } else if (arg == "--in-memory") {
+                in_memory = true;
+            } else if (arg == "--memory-limit" ) {
+                memory_limit = strtol( argv[++i], &offset, 10 );
+            } else if (arg == "--live") {
+                live = true;
+            } else if (arg == "--checkpoint-mb" ) {
+                checkpoint_mb = strtol( argv[++i], &offset, 10 );
+            } else if (arg == "--checkpoint-secs" ) {
+                checkpoint_secs = strtol( argv[++i], &offset, 10 );
             } else if (arg == "--max_hit" ) {
                 max_hit = strtol( argv[++i], &offset, 10 );
+                max_hit_set = true;
             } else if (arg == "--max_hsp" ) {
                 max_hsp = strtol( argv[++i], &offset, 10 );
+                max_hsp_set = true;
+            } else if (arg == "--top-hits" ) {
+                top_hits = strtol( argv[++i], &offset, 10 );
+            } else if (arg == "--top-hsps" ) {
+                top_hsps = strtol( argv[++i], &offset, 10 );
+            } else if (arg == "--signif-evalue" ) {
+                signif_evalue = strtod( argv[++i], &offset );
+            } else if (arg == "--rank-by" ) {
+                std::string by = argv[++i];
+                if (by == "bit_score") {
+                    rank_by = BlastRank::BitScore;
+                } else if (by == "identity") {
+                    rank_by = BlastRank::Identity;
+                } else if (by == "coverage") {
+                    rank_by = BlastRank::Coverage;
+                } else {
+                    cerr << "Unknown ranking '" << by
+                         << "'; use 'bit_score', 'identity', or 'coverage'." << endl;
+                    return 1;
+                }
+            } else if (arg == "--split-deflines" ) {
+                split_deflines = true;
+            } else if (arg == "--sample-every" ) {
+                sample_every = strtol( argv[++i], &offset, 10 );
+            } else if (arg == "--cull" ) {
+                cull = strtol( argv[++i], &offset, 10 );
+            } else if (arg == "--cull-overlap" ) {
+                cull_overlap = strtod( argv[++i], &offset );
+            } else if (arg == "--query-list" ) {
+                query_list = argv[++i];
+            } else if (arg == "--subject-list" ) {
+                subject_list = argv[++i];
+            } else if (arg == "--read-buffer" ) {
+                read_buffer = strtol( argv[++i], &offset, 10 );
+            } else if (arg == "--read-queue" ) {
+                read_queue = strtol( argv[++i], &offset, 10 );
             } else if (arg == "--reset_at" ) {
                 reset_at = strtol( argv[++i], &offset, 10 );
+            } else if (arg == "--max-batch-latency" ) {
+                max_batch_latency = parse_duration_ms( argv[++i] );
+                if (max_batch_latency <= 0) {
+                    cerr << "Invalid --max-batch-latency '" << argv[i]
+                         << "'; use e.g. 5s, 500ms, or 2m." << endl;
+                    return 1;
+                }
+            } else if (arg == "--shards" ) {
+                shards = strtol( argv[++i], &offset, 10 );
+            } else if (arg == "--schema" ) {
+                std::string which = argv[++i];
+                if (which == "full") {
+                    schema = BLAST_DB_SCHEMA;
+                } else if (which == "lean") {
+                    schema = LEAN_BLAST_DB_SCHEMA;
+                } else {
+                    cerr << "Unknown schema '" << which << "'; use 'full' or 'lean'." << endl;
+                    return 1;
+                }
+            } else if (arg == "--format" ) {
+                format = argv[++i];
+                if (format != "sqlite" && format != "sam" && format != "paf") {
+                    cerr << "Unknown format '" << format << "'; use 'sqlite', 'sam', or 'paf'." << endl;
+                    return 1;
+                }
+            } else if (arg == "--if-ingested" ) {
+                if_ingested = argv[++i];
+                if (if_ingested != "fail" && if_ingested != "skip" && if_ingested != "reload") {
+                    cerr << "Unknown --if-ingested '" << if_ingested
+                         << "'; use 'fail', 'skip', or 'reload'." << endl;
+                    return 1;
+                }
+            } else if (arg == "--partition" ) {
+                std::string how = argv[++i];
+                if (how == "range") {
+                    partition = ShardPartition::Range;
+                } else if (how == "hash") {
+                    partition = ShardPartition::Hash;
+                } else {
+                    cerr << "Unknown partition '" << how << "'; use 'range' or 'hash'." << endl;
+                    return 1;
+                }
             }
         } else {
             xmlFile = argv[i];
@@ -78,12 +216,90 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    // ranking only makes sense over all reported hits/hsps, so unless
+    // asked otherwise we do not stop after the first max_hit/max_hsp
+    if (top_hits > 0 && !max_hit_set) {
+        max_hit = -1;
+    }
+    if (top_hsps > 0 && !max_hsp_set) {
+        max_hsp = -1;
+    }
+
+    BlastParseOptions options;
+    options.max_hit = max_hit;
+    options.max_hsp = max_hsp;
+    options.reset_at = reset_at;
+    options.top_hits = top_hits;
+    options.top_hsps = top_hsps;
+    options.rank_by = rank_by;
+    options.signif_evalue = signif_evalue;
+    options.split_deflines = split_deflines;
+    options.sample_every = sample_every > 0 ? sample_every : 1;
+    options.cull = cull;
+    options.cull_overlap = cull_overlap;
+    options.read_buffer = read_buffer > 0 ? static_cast<size_t>(read_buffer) << 20 : 0;
+    options.read_queue = read_queue > 0 ? read_queue : 1;
+
+    if (scan) {
+        // scan only counts tags; it cannot tell which ids or alignments
+        // these would drop, and its projection would be wrong
+        if (!query_list.empty() || !subject_list.empty() || cull > 0) {
+            cerr << "scan does not support --query-list, --subject-list, or --cull." << endl;
+            return 1;
+        }
+        return scan_main(options);
+    }
+
+    try {
+        if (!query_list.empty()) {
+            options.query_list = std::make_shared<IdList>(IdList::fromFile(query_list));
+        }
+        if (!subject_list.empty()) {
+            options.subject_list = std::make_shared<IdList>(IdList::fromFile(subject_list));
+        }
+    }
+    catch (const std::logic_error& toCatch) {
+        cerr << toCatch.what() << endl;
+        return 1;
+    }
+
     if (dbName.empty()) {
         // no dbName has been provided use xml filename as basename
-        dbName = replace_extension(xmlFile, "db");
+        dbName = replace_extension(xmlFile, format == "sqlite" ? "db" : format);
     }
 
-    if (!append && file_exists(dbName)) {
+    if (format != "sqlite") {
+        if (append || in_memory || live || shards > 0) {
+            cerr << "--format " << format << " cannot be combined with --append, --in-memory, --live, "
+                 << "or --shards." << endl;
+            return 1;
+        }
+        if (dbName != "-" && file_exists(dbName)) {
+            cerr << "Output file '" << dbName << "' already exists." << endl;
+            return 1;
+        }
+    } else if (shards > 0) {
+        if (append || in_memory || live) {
+            cerr << "--shards cannot be combined with --append, --in-memory, or --live." << endl;
+            return 1;
+        }
+        for (int k = 0; k < shards; ++k) {
+            std::string shardName = ShardedSqliteDB::shardName(dbName, k);
+            if (file_exists(shardName)) {
+                cerr << "DB file '" << shardName << "' already exists." << endl;
+                return 1;
+            }
+        }
+    } else if (concurrent && !append) {
+        cerr << "--concurrent requires --append." << endl;
+        return 1;
+    } else if (in_memory && append) {
+        cerr << "--in-memory cannot be combined with --append." << endl;
+        return 1;
+    } else if (in_memory && live) {
+        cerr << "--in-memory cannot be combined with --live." << endl;
+        return 1;
+    } else if (!append && file_exists(dbName)) {
         // choose another name or remove the offending file if you don't
         // want to append to an existing B
         cerr << "DB file '" << dbName << "' already exists." << endl;
@@ -95,55 +311,181 @@ int main(int argc, char *argv[])
 //    return 0;
 
     try {
-        XMLPlatformUtils::Initialize();
-    } catch (const XMLException& toCatch) {
-        char* message = XMLString::transcode(toCatch.getMessage ());
-        cout    << "Error during intialisation! :\n"
-                << message << endl;
-        XMLString::release(&message);
-        return 1;
+        BlastParserEnvironment environment;
+        // choose where the parsed queries go
+        std::unique_ptr<BlastVisitor> visitor;
+        SqliteVisitor* sqlite = nullptr;
+        if (format != "sqlite") {
+            visitor.reset(new AlignmentWriter(dbName, format == "sam" ? AlignmentFormat::Sam
+                                                                      : AlignmentFormat::Paf));
+        } else if (shards > 0) {
+            visitor.reset(new ShardedSqliteDB(dbName, schema, shards, partition, reset_at));
+        } else if (append) {
+            visitor.reset(sqlite = new SqliteVisitor(dbName, concurrent ? AppendMode::Concurrent
+                                                                        : AppendMode::Exclusive));
+        } else {
+            sqlite3_int64 limit = static_cast<sqlite3_int64>(memory_limit) << 20;
+            if (memory_limit < 0) {
+                limit = static_cast<sqlite3_int64>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGE_SIZE) / 2;
+            }
+            visitor.reset(sqlite = new SqliteVisitor(dbName, schema, in_memory, limit));
+        }
+        // files are registered in the database, so that storing one twice
+        // is noticed; pipes cannot be recognised
+        std::string fingerprint = sqlite ? file_fingerprint(xmlFile) : "";
+        if (!fingerprint.empty()) {
+            IngestPolicy policy = if_ingested == "skip" ? IngestPolicy::Skip :
+                                  if_ingested == "reload" ? IngestPolicy::Reload : IngestPolicy::Fail;
+            IngestState found;
+            BlastCounters removed;
+            IngestClaim claim = sqlite->claimInput(fingerprint, xmlFile, policy, found, removed);
+            if (claim == IngestClaim::Skipped) {
+                cout << "'" << xmlFile << "' is already "
+                     << (found == IngestState::Running ? "being stored" : "stored")
+                     << " in " << dbName << "; skipping." << endl;
+                return 0;
+            }
+            if (claim == IngestClaim::Refused && found == IngestState::Running) {
+                cerr << "'" << xmlFile << "' is being stored in " << dbName << " by another process." << endl;
+                return 1;
+            }
+            if (claim == IngestClaim::Refused) {
+                cerr << "'" << xmlFile << "' is already "
+                     << (found == IngestState::Complete ? "stored" : "partially stored (interrupted)")
+                     << " in " << dbName << ". Use --if-ingested skip or reload." << endl;
+                return 1;
+            }
+            if (found != IngestState::New) {
+                cout << "Removed " << removed.queries << " queries, " << removed.hits << " hits, and "
+                     << removed.hsps << " hsps stored from '" << xmlFile << "' before." << endl;
+            }
+        }
+        if (live) {
+            sqlite->db().setLive(static_cast<sqlite3_int64>(checkpoint_mb) << 20, checkpoint_secs);
+        }
+        std::unique_ptr<TimedBatchVisitor> timed;
+        if (max_batch_latency > 0) {
+            // the parser hands over every query at once; batches are cut
+            // by size or age on the writer side
+            timed.reset(new TimedBatchVisitor(*visitor, reset_at,
+                                              std::chrono::milliseconds(max_batch_latency)));
+            options.reset_at = 1;
+        }
+        parseBlast(xmlFile, timed ? *timed : *visitor, options);
+    }
+    catch (const std::logic_error& toCatch) {
+        cout << toCatch.what() << endl;
+        return -1;
+    }
+    catch (...) {
+        cout << "Unexpected exception" << endl;
+        return -1;
     }
 
+    return 0;
+}
+
+// bigBlastParser scan [options] <blastfile.xml>: what parsing with
+// options would store, and how large the database would get
+static int scan_main(const BlastParseOptions& options)
+{
+    BlastScanStats stats;
     try {
-        // optain parser and register the Blast Query Handler
-        std::unique_ptr<SAX2XMLReader> parser{ XMLReaderFactory::createXMLReader() };
-        std::vector<BlastQuery> queryList;
-        if (append)
-        {
-            BlastQueryContentHandler queryHandler(queryList, dbName, max_hit, max_hsp, reset_at);
-            parser->setFeature(XMLUni::fgXercesLoadExternalDTD, false);
-            parser->setContentHandler(&queryHandler);
-            parser->setErrorHandler(&queryHandler);
-            parser->parse(xmlFile.c_str());
-        }
-        else
-        {
-            BlastQueryContentHandler queryHandler(queryList, dbName, BLAST_DB_SCHEMA, max_hit, max_hsp, reset_at);
-            parser->setFeature(XMLUni::fgXercesLoadExternalDTD, false);
-            parser->setContentHandler(&queryHandler);
-            parser->setErrorHandler(&queryHandler);
-            parser->parse(xmlFile.c_str());
-        }
-    } catch (const XMLException& toCatch) {
-        char* message = XMLString::transcode(toCatch.getMessage ());
-        cout << "Exception message is: \n"
-             << message << endl;
-        XMLString::release(&message);
-        return -1;
+        stats = scanBlast(xmlFile, options);
     }
-    catch (const SAXParseException& toCatch) {
-        char* message = XMLString::transcode(toCatch.getMessage ());
-        cout << "Exception message is: \n"
-             << message << endl;
-        XMLString::release(&message);
+    catch (const std::logic_error& toCatch) {
+        cout << toCatch.what() << endl;
         return -1;
     }
-    catch (...) {
-        cout << "Unexpected exception" << endl;
+    bool lean = schema == LEAN_BLAST_DB_SCHEMA;
+    double mib = 1024.0 * 1024.0;
+    cout << "file:		" << xmlFile << " (" << stats.bytes / mib << " MiB)\n"
+         << "queries:	" << stats.queries << " (" << stats.kept_queries << " kept)\n"
+         << "hits:		" << stats.hits << " (" << stats.kept_hits << " kept)\n"
+         << "hsps:		" << stats.hsps << " (" << stats.kept_hsps << " kept)\n"
+         << "subjects:	" << stats.subjects << "\n"
+         << "sequences:	" << stats.sequence_bytes / mib << " MiB\n"
+         << "projected DB:	" << projected_db_size(stats, lean) / mib << " MiB ("
+         << (lean ? "lean" : "full") << " schema)\n"
+         << "scanned in:	" << stats.seconds << " s ("
+         << (stats.seconds > 0 ? stats.bytes / mib / stats.seconds : 0) << " MiB/s)"
+         << endl;
+    return 0;
+}
+
+// bigBlastParser remove -o <db> <blastfile.xml | fingerprint>: take the
+// rows a file added out of a database again
+static int remove_main(int argc, char *argv[])
+{
+    std::string what;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "-o" || arg == "--out") && i + 1 != argc) {
+            dbName = argv[++i];
+        } else {
+            what = arg;
+        }
+    }
+    if (dbName.empty() || what.empty()) {
+        cerr << "USAGE:\n\t" << argv[0] << " remove -o <blast>.db <blastfile.xml | fingerprint>\n" << endl;
+        return 1;
+    }
+    if (!file_exists(dbName)) {
+        cerr << "DB file '" << dbName << "' does not exist." << endl;
+        return 1;
+    }
+    try {
+        std::string fingerprint = file_exists(what) ? file_fingerprint(what) : what;
+        SqliteDB db(dbName);
+        create_ingest_registry(db);
+        BlastCounters removed;
+        if (!remove_ingested(db, fingerprint, removed)) {
+            cerr << "'" << what << "' is not registered in " << dbName << "." << endl;
+            return 1;
+        }
+        cout << "Removed " << removed.queries << " queries, " << removed.hits << " hits, "
+             << removed.hsps << " hsps, and " << removed.subjects << " subjects." << endl;
+    } catch (const std::logic_error& toCatch) {
+        cerr << toCatch.what() << endl;
         return -1;
     }
+    return 0;
+}
 
-    XMLPlatformUtils::Terminate();
+// bigBlastParser merge -o <out.db> <shard.db>...
+static int merge_main(int argc, char *argv[])
+{
+    std::string outName;
+    std::vector<std::string> shardNames;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "-o" || arg == "--out") && i + 1 != argc) {
+            outName = argv[++i];
+        } else {
+            shardNames.push_back(arg);
+        }
+    }
+    if (outName.empty() || shardNames.empty()) {
+        cerr << "USAGE:\n\t" << argv[0] << " merge -o <merged>.db <shard>.db...\n" << endl;
+        return 1;
+    }
+    if (file_exists(outName)) {
+        cerr << "DB file '" << outName << "' already exists." << endl;
+        return 1;
+    }
+    for (auto& shardName : shardNames) {
+        if (!file_exists(shardName)) {
+            cerr << "DB file '" << shardName << "' does not exist." << endl;
+            return 1;
+        }
+    }
+    try {
+        // the merged database gets the schema the shards were created with
+        merge_shards(outName, shardNames, stored_schema(shardNames.front()));
+    } catch (const std::logic_error& toCatch) {
+        cerr << toCatch.what() << endl;
+        return -1;
+    }
     return 0;
 }
 
@@ -152,12 +494,68 @@ static void show_usage(std::string name) {
          << "OPTIONS:\n"
          << "\t-h,--help\t\tShow this help message\n"
          << "\t-o,--out <filename>\tPath to SQLite file. Default [<blastfile>.db].\n"
+         << "\t--format <which>\t'sqlite', or write the hsps as 'sam' or 'paf' to the\n"
+         << "\t\t\t\t--out file ('-' for stdout). Default [sqlite].\n"
          << "\t-a, --append\t\tAppend data to an existing SQlite DB.\n"
+         << "\t--concurrent\t\tWith --append: lock the DB only while writing a batch,\n"
+         << "\t\t\t\tso that several processes can append at once.\n"
+         << "\t--in-memory\t\tBuild the DB in memory and write it to disk at the end.\n"
+         << "\t--memory-limit <MiB>\tWith --in-memory: continue on disk once the DB grows\n"
+         << "\t\t\t\tbeyond <MiB> (0: no limit). Default [half the RAM].\n"
+         << "\t--live\t\t\tLet others read the DB while parsing (WAL journal,\n"
+         << "\t\t\t\tno exclusive lock).\n"
+         << "\t--checkpoint-mb <n>\tWith --live: checkpoint once the WAL reaches <n> MiB.\n"
+         << "\t\t\t\tDefault [64].\n"
+         << "\t--checkpoint-secs <n>\tWith --live: checkpoint every <n> seconds. Default [30].\n"
          << "\t--max_hit <n>\t\tNumber of hits parsed. Default [20] (set [-1] for all).\n"
          << "\t--max_hsp <n>\t\tNumber of hsps parsed. Default [20] (set [-1] for all).\n"
+         << "\t--top-hits <k>\t\tKeep only the best <k> hits of a query, ranked by\n"
+         << "\t\t\t\t--rank-by. Implies --max_hit -1 unless given.\n"
+         << "\t--top-hsps <k>\t\tKeep only the best <k> hsps of a hit, ranked by\n"
+         << "\t\t\t\t--rank-by. Implies --max_hsp -1 unless given.\n"
+         << "\t--rank-by <field>\t'bit_score', 'identity', or (query) 'coverage'.\n"
+         << "\t\t\t\tDefault [bit_score].\n"
+         << "\t--signif-evalue <e>\tHits with an e-value <= <e> count as significant in\n"
+         << "\t\t\t\tthe query_summary table. Default [1e-5].\n"
+         << "\t--split-deflines\tStore each defline of a merged (nr) Hit_def in the\n"
+         << "\t\t\t\tdefline table.\n"
+         << "\t--sample-every <k>\tStore only every <k>-th query (1st, k+1-th, ...).\n"
+         << "\t\t\t\tDefault [1] (all).\n"
+         << "\t--cull <n>\t\tDrop hsps whose query range is mostly covered by <n>\n"
+         << "\t\t\t\thigher-scoring hsps of the same query. Default [0] (off).\n"
+         << "\t--cull-overlap <pct>\tWith --cull: the percentage of an hsp's query range\n"
+         << "\t\t\t\teach better hsp must cover. Default [50].\n"
+         << "\t--query-list <file>\tStore only the queries whose id (first word of\n"
+         << "\t\t\t\tquery_def) is listed in <file>, one per line.\n"
+         << "\t--subject-list <file>\tStore only the hits whose subject accession (or\n"
+         << "\t\t\t\tHit_id) is listed in <file>, one per line.\n"
+         << "\t--read-buffer <MiB>\tRead the XML file in chunks of <MiB> on a read-ahead\n"
+         << "\t\t\t\tthread (0: no read-ahead). Default [4].\n"
+         << "\t--read-queue <n>\tNumber of chunks read ahead. Default [4].\n"
          << "\t--reset_at <n>\t\tAfter <n> parsed queries the data is dumped to"
          << " the SQLite DB.\n\t\t\t\tDefault [1000].\n"
+         << "\t--max-batch-latency <t>\tAlso dump once the oldest parsed query has waited <t>\n"
+         << "\t\t\t\t(e.g. 5s, 500ms, 2m).\n"
+         << "\t--if-ingested <what>\tIf the file is already stored in the DB: 'fail',\n"
+         << "\t\t\t\t'skip' it (an interrupted ingest is replaced), or\n"
+         << "\t\t\t\t'reload' it. A file another process is storing is\n"
+         << "\t\t\t\tnever replaced. Default [fail].\n"
+         << "\t--schema <which>\t'full' or 'lean' (WITHOUT ROWID hit and hsp tables\n"
+         << "\t\t\t\tclustered by query, fewer indexes). Default [full].\n"
+         << "\t--shards <n>\t\tWrite queries into <n> SQLite files <blastfile>.shard<k>.db\n"
+         << "\t\t\t\ton <n> writer threads. Default [0] (single file).\n"
+         << "\t--partition <how>\tAssign queries to shards by query_id 'range'\n"
+         << "\t\t\t\t(blocks of reset_at queries) or by 'hash' of query_def.\n"
+         << "\t\t\t\tDefault [range].\n"
          << "\t<blastfile.xml> Input file.\n"
+         << "\n\t" << name << " scan [options] <blastfile>.xml\n"
+         << "\t\t\t\tCount queries, hits, and hsps without parsing, and\n"
+         << "\t\t\t\tproject the DB size for the given options. Refuses\n"
+         << "\t\t\t\t--query-list, --subject-list, and --cull.\n"
+         << "\n\t" << name << " remove -o <blast>.db <blastfile.xml | fingerprint>\n"
+         << "\t\t\t\tRemove the rows a file added from the DB.\n"
+         << "\n\t" << name << " merge -o <merged>.db <shard>.db...\n"
+         << "\t\t\t\tMerge shard databases into a single database.\n"
          << "DESCRIPTION\n"
          << "\tblastParse 0.1.1 -- Convert XML Blast Reports to an SQLite DB\n\n"
          << endl;
@@ -214,4 +612,18 @@ inline bool file_exists( std::string& name ) {
 //         << "\ncheckFileName: " << checkFileName << endl;
 //}
 
-
+// "5s", "500ms", "2m", or plain seconds in milliseconds; 0 if invalid
+static long parse_duration_ms(const std::string& text)
+{
+    char* unit;
+    double value = strtod(text.c_str(), &unit);
+    std::string suffix(unit);
+    if (suffix == "ms") {
+        return static_cast<long>(value);
+    } else if (suffix == "s" || suffix.empty()) {
+        return static_cast<long>(value * 1000);
+    } else if (suffix == "m") {
+        return static_cast<long>(value * 60000);
+    }
+    return 0;
+}
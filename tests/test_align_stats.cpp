@@ -0,0 +1,105 @@
+// Compares every align_stats kernel the CPU supports with the scalar loop
+// on random alignments: all lengths up to a few vector widths, which ends
+// blocks anywhere in the 16 and 32 column strides, then longer ones; mixed
+// case residues, gap runs, and unaligned starts.
+
+#include <cctype>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "AlignStats.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static std::mt19937 rng(20261018);
+
+// a gapped sequence of n columns; gaps come in runs so that runs cross
+// block borders
+static std::string random_row(size_t n)
+{
+    static const char residues[] = "ACGTNacgtnRKrk*x";
+    std::uniform_int_distribution<int> residue(0, sizeof(residues) - 2);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::string row;
+    bool gap = false;
+    while (row.size() < n) {
+        gap = gap ? percent(rng) < 70 : percent(rng) < 10;
+        row += gap ? '-' : residues[residue(rng)];
+    }
+    return row;
+}
+
+// the subject row: mostly the query, in either case, with substitutions
+// and its own gaps
+static std::string similar_row(const std::string& query)
+{
+    std::string row = random_row(query.size());
+    std::uniform_int_distribution<int> percent(0, 99);
+    for (size_t i = 0; i < row.size(); ++i) {
+        int p = percent(rng);
+        if (row[i] != '-' && p < 60) {
+            row[i] = query[i];
+            if (p < 20 && std::isalpha(static_cast<unsigned char>(row[i]))) {
+                row[i] ^= 0x20;     // flip the case
+            }
+        }
+    }
+    return row;
+}
+
+static bool same(const AlignStats& a, const AlignStats& b)
+{
+    return a.matches == b.matches && a.mismatches == b.mismatches &&
+           a.query_gaps == b.query_gaps && a.hit_gaps == b.hit_gaps &&
+           a.gap_opens == b.gap_opens;
+}
+
+static void print(const char* name, const AlignStats& s)
+{
+    cerr << "  " << name << ": matches " << s.matches << ", mismatches " << s.mismatches
+         << ", query gaps " << s.query_gaps << ", hit gaps " << s.hit_gaps
+         << ", gap opens " << s.gap_opens << endl;
+}
+
+int main()
+{
+    std::vector<KernelChoice> kernels = align_stats_kernels();
+    int failures = 0;
+    int alignments = 0;
+    std::uniform_int_distribution<size_t> longer(97, 5000);
+    std::uniform_int_distribution<size_t> offset(0, 31);
+    for (int round = 0; round < 4000 && failures < 10; ++round) {
+        size_t n = round < 1000 ? round % 97 : longer(rng);
+        std::string qseq = random_row(n);
+        std::string hseq = similar_row(qseq);
+        // copies at odd addresses, so that loads are not aligned
+        size_t shift = offset(rng);
+        std::string qbuf = std::string(shift, 'Q') + qseq;
+        std::string hbuf = std::string(31 - shift, 'H') + hseq;
+        const char* q = qbuf.data() + shift;
+        const char* h = hbuf.data() + 31 - shift;
+
+        AlignStats expected = align_stats_scalar(q, h, n);
+        for (auto& kernel : kernels) {
+            AlignStats got = kernel.kernel(q, h, n);
+            if (!same(got, expected)) {
+                cerr << kernel.name << " differs from the scalar loop on " << n << " columns:\n"
+                     << "  " << qseq << "\n  " << hseq << endl;
+                print(kernel.name, got);
+                print("scalar", expected);
+                ++failures;
+            }
+        }
+        ++alignments;
+    }
+
+    cout << "align_stats:";
+    for (auto& kernel : kernels) {
+        cout << " " << kernel.name;
+    }
+    cout << " on " << alignments << " alignments, " << failures << " failures" << endl;
+    return failures == 0 ? 0 : 1;
+}
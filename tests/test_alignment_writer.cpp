@@ -0,0 +1,188 @@
+// Compares cigar_ops with the scalar loop on random alignments of every
+// length up to a few 64 column blocks and longer ones, then writes hsps on
+// both strands of blastn, tblastn, and tblastx as SAM and checks CIGAR,
+// flag, position, and SEQ of each line: only nucleotides are reverse
+// complemented, amino acids on a minus strand are just reversed.
+
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "AlignmentWriter.hpp"
+#include "Cigar.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static std::mt19937 rng(20261019);
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        cerr << what << endl;
+        ++failures;
+    }
+}
+
+// a gapped query row of n columns and a subject row against it; gaps come
+// in runs, never in both rows of a column
+static void random_rows(size_t n, std::string& qseq, std::string& hseq)
+{
+    static const char residues[] = "ACGTNacgtnRKrk*x";
+    std::uniform_int_distribution<int> residue(0, sizeof(residues) - 2);
+    std::uniform_int_distribution<int> percent(0, 99);
+    qseq.clear();
+    hseq.clear();
+    int gap = 0;    // 0: none, 1: in the query, 2: in the subject
+    while (qseq.size() < n) {
+        gap = gap ? (percent(rng) < 70 ? gap : 0) : (percent(rng) < 10 ? 1 + percent(rng) % 2 : 0);
+        qseq += gap == 1 ? '-' : residues[residue(rng)];
+        hseq += gap == 2 ? '-' : residues[residue(rng)];
+    }
+}
+
+static std::string cigar(const std::vector<CigarOp>& ops)
+{
+    std::ostringstream out;
+    for (auto& op : ops) {
+        out << op.len << op.op;
+    }
+    return out.str();
+}
+
+static void test_cigar_ops()
+{
+    std::uniform_int_distribution<size_t> longer(200, 5000);
+    std::uniform_int_distribution<size_t> offset(0, 15);
+    std::string qseq, hseq;
+    std::vector<CigarOp> got, expected;
+    for (int round = 0; round < 3000; ++round) {
+        size_t n = round < 1000 ? round % 200 : longer(rng);
+        random_rows(n, qseq, hseq);
+        // copies at odd addresses, so that loads are not aligned
+        size_t shift = offset(rng);
+        std::string qbuf = std::string(shift, 'Q') + qseq;
+        std::string hbuf = std::string(15 - shift, 'H') + hseq;
+        cigar_ops(qbuf.data() + shift, hbuf.data() + 15 - shift, n, got);
+        cigar_ops_scalar(qseq.data(), hseq.data(), n, expected);
+        if (cigar(got) != cigar(expected)) {
+            cerr << "cigar_ops differs from the scalar loop on " << n << " columns:\n  "
+                 << qseq << "\n  " << hseq << "\n  " << cigar(got) << "\n  "
+                 << cigar(expected) << endl;
+            if (++failures >= 10) {
+                return;
+            }
+        }
+    }
+}
+
+// one hit on the given strands, with a single hsp
+static BlastHit hit(const std::string& accession, int query_from, int query_to, int hit_from,
+                    int hit_to, int query_frame, int hit_frame, const std::string& qseq,
+                    const std::string& hseq)
+{
+    Hsp hsp(1, 50.0, 100, 1e-10, query_from, query_to, hit_from, hit_to, query_frame,
+            hit_frame, 0, 0, 0, qseq.size(), qseq, hseq, "");
+    BlastHit hit;
+    hit.setHitAccession(accession);
+    hit.setHitLen(1000);
+    hit.setHsp(std::vector<Hsp>(1, hsp));
+    return hit;
+}
+
+// the fields of each SAM line but the header
+static std::vector<std::vector<std::string>> sam_lines(const std::string& path)
+{
+    std::vector<std::vector<std::string>> lines;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '@') {
+            continue;
+        }
+        std::vector<std::string> fields;
+        std::istringstream tabs(line);
+        std::string field;
+        while (std::getline(tabs, field, '\t')) {
+            fields.push_back(field);
+        }
+        lines.push_back(fields);
+    }
+    return lines;
+}
+
+static void test_sam()
+{
+    struct Expected
+    {
+        const char* name;
+        const char* flag;
+        const char* pos;
+        const char* cigar;
+        const char* seq;
+    };
+    // query length 20 in every case
+    std::vector<BlastHit> hits;
+    std::vector<Expected> expected;
+    hits.push_back(hit("NT_1", 3, 9, 43, 50, 1, 1, "ACG-TTAC", "ACGGTT-C"));
+    expected.push_back({ "blastn plus strand", "0", "43", "2H3M1D2M1I1M11H", "ACGTTAC" });
+    hits.push_back(hit("NT_2", 3, 9, 50, 43, 1, -1, "ACG-TTAC", "ACGGTT-C"));
+    expected.push_back({ "blastn minus strand", "272", "43", "11H1M1I2M1D3M2H", "GTAACGT" });
+    hits.push_back(hit("NT_3", 1, 5, 300, 283, 0, -2, "MAV-LT", "MRVALT"));
+    expected.push_back({ "tblastn minus strand", "272", "283", "15H2M1D3M", "TLVAM" });
+    hits.push_back(hit("NT_4", 1, 18, 120, 103, 1, -1, "ACDEFG", "ACDEYG"));
+    expected.push_back({ "tblastx minus strand", "272", "103", "2H6M", "GFEDCA" });
+
+    std::vector<BlastQuery> batch(1);
+    batch[0].setQueryNum(1);
+    batch[0].setQueryDef("read_1 some query");
+    batch[0].setQueryLen(20);
+    batch[0].setHit(hits);
+
+    char path[] = "/tmp/test_alignment_writerXXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    {
+        BlastCounters counters;
+        SubjectInterner subjects;
+        AlignmentWriter writer(path, AlignmentFormat::Sam);
+        writer.onStart(counters, subjects);
+        writer.onBatch(batch);
+        writer.onFinish(counters);
+    }
+    std::vector<std::vector<std::string>> lines = sam_lines(path);
+    std::remove(path);
+
+    check(lines.size() == expected.size(), "SAM: expected " + std::to_string(expected.size()) +
+          " lines, got " + std::to_string(lines.size()));
+    for (size_t i = 0; i < lines.size() && i < expected.size(); ++i) {
+        const std::vector<std::string>& fields = lines[i];
+        const Expected& e = expected[i];
+        if (fields.size() < 11) {
+            check(false, std::string("SAM ") + e.name + ": too few fields");
+            continue;
+        }
+        check(fields[0] == "read_1", std::string("SAM ") + e.name + ": read name " + fields[0]);
+        check(fields[1] == e.flag, std::string("SAM ") + e.name + ": flag " + fields[1]);
+        check(fields[3] == e.pos, std::string("SAM ") + e.name + ": position " + fields[3]);
+        check(fields[5] == e.cigar, std::string("SAM ") + e.name + ": CIGAR " + fields[5] +
+              ", expected " + e.cigar);
+        check(fields[9] == e.seq, std::string("SAM ") + e.name + ": SEQ " + fields[9] +
+              ", expected " + e.seq);
+    }
+}
+
+int main()
+{
+    test_cigar_ops();
+    test_sam();
+    cout << "alignment writer: " << failures << " failures" << endl;
+    return failures == 0 ? 0 : 1;
+}
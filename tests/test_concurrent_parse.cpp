@@ -0,0 +1,133 @@
+// Runs several parses at once, each with its own handler on its own
+// thread, over two generated inputs read from files and from streams, and
+// checks that every one reports exactly what a parse on its own does.
+
+#include <unistd.h>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "BlastParser.hpp"
+#include "test_input.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static const int THREADS = 8;
+static const int ROUNDS = 3;
+
+// Writes down everything it is handed, in order
+class RecordingVisitor : public BlastVisitor
+{
+public:
+    void onQuery(BlastQuery& query) {
+        out_ << "Q " << query.getID() << " " << query.getQueryDef() << "\n";
+        for (auto& hit : query.getHit()) {
+            out_ << " H " << hit.getID() << " " << hit.getHitNum() << " " << hit.getSubjectID()
+                 << " " << hit.getGi() << " " << hit.getHitAccession() << " " << hit.getHitDef()
+                 << " " << hit.getDeflines().size() << " " << hit.getQueryCoverage() << "\n";
+            for (auto& hsp : hit.getHsp()) {
+                out_ << "  S " << hsp.getID() << " " << hsp.getBitScore() << " " << hsp.getEvalue()
+                     << " " << hsp.getMismatches() << " " << hsp.getGapOpens() << " "
+                     << hsp.getQSeq() << " " << hsp.getHSeq() << "\n";
+            }
+        }
+    }
+    void onBatch(std::vector<BlastQuery>& batch) { out_ << "B " << batch.size() << "\n"; }
+    void onFinish(const BlastCounters& counters) {
+        out_ << "F " << counters.queries << " " << counters.hits << " " << counters.hsps
+             << " " << counters.subjects << "\n";
+    }
+
+    std::string record() const { return out_.str(); }
+
+private:
+    std::ostringstream out_;
+};
+
+struct Input
+{
+    std::string xml;
+    std::string path;
+    BlastParseOptions options;
+};
+
+static std::string parse(const Input& input, bool from_file)
+{
+    RecordingVisitor visitor;
+    if (from_file) {
+        parseBlast(input.path, visitor, input.options);
+    } else {
+        std::istringstream in(input.xml);
+        parseBlast(in, visitor, input.options);
+    }
+    return visitor.record();
+}
+
+int main()
+{
+    BlastParserEnvironment environment;
+
+    // two inputs with different options, so that handlers in different
+    // states run side by side
+    Input inputs[2];
+    inputs[0].xml = blast_xml(1, 300);
+    inputs[0].options.reset_at = 50;
+    inputs[1].xml = blast_xml(2, 200);
+    inputs[1].options.reset_at = 7;
+    inputs[1].options.max_hit = 5;
+    inputs[1].options.top_hsps = 2;
+    inputs[1].options.split_deflines = true;
+    inputs[1].options.read_buffer = 4096;
+    for (auto& input : inputs) {
+        char path[] = "/tmp/test_concurrent_parseXXXXXX";
+        int fd = mkstemp(path);
+        if (fd < 0 || write(fd, input.xml.data(), input.xml.size()) != static_cast<ssize_t>(input.xml.size())) {
+            cerr << "Cannot write a temporary file." << endl;
+            return 1;
+        }
+        close(fd);
+        input.path = path;
+    }
+
+    int failures = 0;
+    try {
+        std::string expected[2] = { parse(inputs[0], true), parse(inputs[1], true) };
+        for (int round = 0; round < ROUNDS; ++round) {
+            std::vector<std::string> got(THREADS);
+            std::vector<std::string> errors(THREADS);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < THREADS; ++t) {
+                threads.emplace_back([t, &inputs, &got, &errors] {
+                    try {
+                        got[t] = parse(inputs[t % 2], t % 4 < 2);
+                    } catch (const std::exception& e) {
+                        errors[t] = e.what();
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            for (int t = 0; t < THREADS; ++t) {
+                if (!errors[t].empty() || got[t] != expected[t % 2]) {
+                    cerr << "round " << round << ", thread " << t << ": "
+                         << (errors[t].empty() ? "differs from the serial parse" : errors[t]) << endl;
+                    ++failures;
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        cerr << e.what() << endl;
+        ++failures;
+    }
+    for (auto& input : inputs) {
+        std::remove(input.path.c_str());
+    }
+
+    cout << "concurrent parse: " << ROUNDS << " rounds of " << THREADS << " threads, "
+         << failures << " failures" << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+#ifndef TEST_INPUT_HPP
+#define TEST_INPUT_HPP
+
+#include <random>
+#include <sstream>
+#include <string>
+
+// A BLAST XML document of n queries with random hits and hsps
+inline std::string blast_xml(unsigned seed, int n)
+{
+    std::mt19937 rng(seed);
+    auto pick = [&rng](int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng); };
+    std::ostringstream xml;
+    xml << "<?xml version=\"1.0\"?>\n<BlastOutput>\n<BlastOutput_program>blastn</BlastOutput_program>\n"
+        << "<BlastOutput_iterations>\n";
+    for (int q = 1; q <= n; ++q) {
+        xml << "<Iteration>\n<Iteration_iter-num>" << q << "</Iteration_iter-num>\n"
+            << "<Iteration_query-ID>Query_" << q << "</Iteration_query-ID>\n"
+            << "<Iteration_query-def>query" << seed << "_" << q << " &amp; description</Iteration_query-def>\n"
+            << "<Iteration_query-len>" << pick(500, 3000) << "</Iteration_query-len>\n<Iteration_hits>\n";
+        int hits = pick(0, 12);
+        for (int h = 1; h <= hits; ++h) {
+            int subject = pick(1, 400);
+            xml << "<Hit>\n<Hit_num>" << h << "</Hit_num>\n"
+                << "<Hit_id>gi|" << 3000000000LL + subject << "|ref|XP_" << subject << ".1|</Hit_id>\n"
+                << "<Hit_def>subject " << subject << " &gt;gi|" << 100 + subject << "|ref|NP_"
+                << subject << ".2| same sequence</Hit_def>\n"
+                << "<Hit_accession>XP_" << subject << "</Hit_accession>\n"
+                << "<Hit_len>" << 1000 + subject << "</Hit_len>\n<Hit_hsps>\n";
+            int hsps = pick(1, 4);
+            for (int k = 1; k <= hsps; ++k) {
+                int len = pick(20, 120);
+                std::string qseq, hseq;
+                int identity = 0;
+                for (int i = 0; i < len; ++i) {
+                    qseq += "ACGT-"[pick(0, 4)];
+                    hseq += pick(0, 3) ? qseq.back() : "acgt-"[pick(0, 4)];
+                    identity += qseq.back() == hseq.back() && qseq.back() != '-';
+                }
+                int from = pick(1, 400);
+                xml << "<Hsp>\n<Hsp_num>" << k << "</Hsp_num>\n"
+                    << "<Hsp_bit-score>" << pick(20, 500) << "." << pick(0, 99) << "</Hsp_bit-score>\n"
+                    << "<Hsp_score>" << pick(40, 1000) << "</Hsp_score>\n"
+                    << "<Hsp_evalue>" << pick(1, 9) << "e-" << pick(1, 80) << "</Hsp_evalue>\n"
+                    << "<Hsp_query-from>" << from << "</Hsp_query-from>\n"
+                    << "<Hsp_query-to>" << from + len << "</Hsp_query-to>\n"
+                    << "<Hsp_hit-from>" << from + 7 << "</Hsp_hit-from>\n"
+                    << "<Hsp_hit-to>" << from + 7 + len << "</Hsp_hit-to>\n"
+                    << "<Hsp_query-frame>1</Hsp_query-frame>\n<Hsp_hit-frame>1</Hsp_hit-frame>\n"
+                    << "<Hsp_identity>" << identity << "</Hsp_identity>\n"
+                    << "<Hsp_positive>" << identity << "</Hsp_positive>\n"
+                    << "<Hsp_gaps>0</Hsp_gaps>\n<Hsp_align-len>" << len << "</Hsp_align-len>\n"
+                    << "<Hsp_qseq>" << qseq << "</Hsp_qseq>\n<Hsp_hseq>" << hseq << "</Hsp_hseq>\n"
+                    << "<Hsp_midline></Hsp_midline>\n</Hsp>\n";
+            }
+            xml << "</Hit_hsps>\n</Hit>\n";
+        }
+        xml << "</Iteration_hits>\n</Iteration>\n";
+    }
+    xml << "</BlastOutput_iterations>\n</BlastOutput>\n";
+    return xml.str();
+}
+
+#endif // TEST_INPUT_HPP
@@ -0,0 +1,158 @@
+// Appends to databases whose id allocator starts above 2^31 (and 2^32 for
+// hits and hsps), then reads the rows back through RowCursor: the ids must
+// come back unchanged, link up, and follow the same layout as in a
+// database numbered from 1.
+
+#include <unistd.h>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+#include "BlastParser.hpp"
+#include "SQLiteVisitor.hpp"
+#include "test_input.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static const RowId FIRST_QUERY = (1LL << 31) + 3;
+static const RowId FIRST_HIT = (1LL << 32) + 5;
+static const RowId FIRST_HSP = (1LL << 33) + 7;
+static const RowId FIRST_SUBJECT = (1LL << 31) + 11;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        cerr << what << endl;
+        ++failures;
+    }
+}
+
+static std::string temp_db()
+{
+    char path[] = "/tmp/test_large_idsXXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    std::remove(path);
+    return path;
+}
+
+static void parse_into(SqliteVisitor& visitor, const std::string& xml)
+{
+    BlastParseOptions options;
+    options.reset_at = 40;
+    options.split_deflines = true;
+    std::istringstream in(xml);
+    parseBlast(in, visitor, options);
+}
+
+// One line for each of the n hsps from id hsp on, in id order, with its
+// hit, query, and subject; ids are taken relative to the first ones. An
+// hsp whose links are broken drops out of the joins.
+static std::vector<std::string> hsp_rows(SqliteDB& db, RowId query, RowId hit, RowId hsp, RowId n)
+{
+    std::vector<std::string> rows;
+    auto cursor = db.cursor("SELECT hsp.hsp_id, hsp.hit_id, hsp.query_id, hit.hit_num, hsp.qseq, "
+                            "query.query_def, subject.accession, subject.gi "
+                            "FROM hsp JOIN hit ON hsp.hit_id = hit.hit_id AND hsp.query_id = hit.query_id "
+                            "JOIN query ON hit.query_id = query.query_id "
+                            "JOIN subject ON hit.subject_id = subject.subject_id "
+                            "WHERE hsp.hsp_id >= " + std::to_string(hsp) + " AND hsp.hsp_id < " +
+                            std::to_string(hsp + n) + " ORDER BY hsp.hsp_id;");
+    while (cursor.next()) {
+        std::ostringstream row;
+        row << cursor.getInteger(0) - hsp << " " << cursor.getInteger(1) - hit << " "
+            << cursor.getInteger(2) - query << " " << cursor.getInteger(3) << " "
+            << cursor.getText(4).str() << " " << cursor.getText(5).str() << " "
+            << cursor.getText(6).str() << " " << cursor.getInteger(7);
+        rows.push_back(row.str());
+    }
+    return rows;
+}
+
+static RowId scalar(SqliteDB& db, const std::string& sql)
+{
+    auto cursor = db.cursor(sql);
+    cursor.next();
+    return cursor.getInteger(0);
+}
+
+static void test_schema(const std::string& name, const std::string& schema, const std::string& xml)
+{
+    std::string reference = temp_db();
+    std::string appended = temp_db();
+    {
+        SqliteVisitor visitor(reference, schema);
+        parse_into(visitor, xml);
+    }
+    {
+        SqliteDB db(appended, schema);
+        db.exec("INSERT INTO id_allocator VALUES ('query', " + std::to_string(FIRST_QUERY) + "), "
+                "('hit', " + std::to_string(FIRST_HIT) + "), ('hsp', " + std::to_string(FIRST_HSP) + "), "
+                "('subject', " + std::to_string(FIRST_SUBJECT) + ");");
+    }
+    // concurrent appenders take their ids from the allocator, exclusive
+    // ones continue after the largest stored id
+    {
+        SqliteVisitor visitor(appended, AppendMode::Concurrent);
+        parse_into(visitor, xml);
+    }
+    {
+        SqliteVisitor visitor(appended, AppendMode::Exclusive);
+        parse_into(visitor, xml);
+    }
+
+    std::vector<std::string> expected;
+    RowId queries, hits, hsps;
+    {
+        SqliteDB db(reference);
+        queries = scalar(db, "SELECT count(*) FROM query;");
+        hits = scalar(db, "SELECT count(*) FROM hit;");
+        hsps = scalar(db, "SELECT count(*) FROM hsp;");
+        expected = hsp_rows(db, 1, 1, 1, hsps);
+    }
+    check(hsps > 0, name + ": nothing parsed");
+
+    SqliteDB db(appended);
+    check(hsp_rows(db, FIRST_QUERY, FIRST_HIT, FIRST_HSP, hsps) == expected,
+          name + ": hsps appended concurrently differ from the reference");
+    check(hsp_rows(db, FIRST_QUERY + queries, FIRST_HIT + hits, FIRST_HSP + hsps, hsps) == expected,
+          name + ": hsps appended exclusively differ from the reference");
+    check(scalar(db, "SELECT count(*) FROM hsp;") == 2 * hsps, name + ": hsps are missing");
+    check(scalar(db, "SELECT min(query_id) FROM query;") == FIRST_QUERY &&
+          scalar(db, "SELECT max(query_id) FROM query;") == FIRST_QUERY + 2 * queries - 1,
+          name + ": query ids are not the reserved ones");
+    check(scalar(db, "SELECT min(hit_id) FROM hit;") == FIRST_HIT &&
+          scalar(db, "SELECT max(hit_id) FROM hit;") == FIRST_HIT + 2 * hits - 1,
+          name + ": hit ids are not the reserved ones");
+    check(scalar(db, "SELECT min(subject_id) FROM subject;") == FIRST_SUBJECT,
+          name + ": subject ids are not the reserved ones");
+    check(scalar(db, "SELECT count(*) FROM query_summary WHERE query_id NOT IN "
+                     "(SELECT query_id FROM query);") == 0,
+          name + ": summaries refer to missing queries");
+    check(scalar(db, "SELECT count(*) FROM defline;") > 0 &&
+          scalar(db, "SELECT count(*) FROM defline WHERE subject_id NOT IN "
+                     "(SELECT subject_id FROM subject);") == 0,
+          name + ": deflines refer to missing subjects");
+
+    std::remove(reference.c_str());
+    std::remove(appended.c_str());
+}
+
+int main()
+{
+    BlastParserEnvironment environment;
+    std::string xml = blast_xml(3, 150);
+    try {
+        test_schema("full schema", BLAST_DB_SCHEMA, xml);
+        test_schema("lean schema", LEAN_BLAST_DB_SCHEMA, xml);
+    } catch (const std::exception& e) {
+        cerr << e.what() << endl;
+        ++failures;
+    }
+    cout << "ids above 2^31: " << failures << " failures" << endl;
+    return failures == 0 ? 0 : 1;
+}
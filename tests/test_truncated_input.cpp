@@ -0,0 +1,120 @@
+// Cuts a generated document off at many points, inside tags, text, and
+// between elements, and checks that parsing every cut, with parseBlast and
+// with the pull reader, fails with a std::logic_error instead of ending as
+// if the document were complete.
+
+#include <unistd.h>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "BlastParser.hpp"
+#include "BlastQueryReader.hpp"
+#include "test_input.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static int failures = 0;
+
+// true if parsing xml, from a stream or else from a file, throws
+// std::logic_error
+static bool parse_fails(const std::string& xml, bool from_file = false)
+{
+    BlastVisitor visitor;
+    BlastParseOptions options;
+    options.reset_at = 10;
+    try {
+        if (from_file) {
+            char path[] = "/tmp/test_truncated_inputXXXXXX";
+            int fd = mkstemp(path);
+            bool written = fd >= 0 && write(fd, xml.data(), xml.size()) == static_cast<ssize_t>(xml.size());
+            close(fd);
+            struct Remove {
+                const char* path;
+                ~Remove() { std::remove(path); }
+            } remove = { path };
+            if (!written) {
+                cerr << "Cannot write a temporary file." << endl;
+                return false;
+            }
+            parseBlast(path, visitor, options);
+        } else {
+            std::istringstream in(xml);
+            parseBlast(in, visitor, options);
+        }
+    } catch (const std::logic_error&) {
+        return true;
+    }
+    return false;
+}
+
+// the number of queries a pull reader hands out before the end, or -1 if
+// it throws std::logic_error; a reader that threw must be done
+static int pull_queries(const std::string& xml)
+{
+    std::istringstream in(xml);
+    BlastQueryReader reader(in);
+    BlastQuery query;
+    int queries = 0;
+    try {
+        while (reader.next(query)) {
+            ++queries;
+        }
+    } catch (const std::logic_error&) {
+        if (!reader.done() || reader.next(query)) {
+            cerr << "BlastQueryReader: goes on after an error" << endl;
+            ++failures;
+        }
+        return -1;
+    }
+    return queries;
+}
+
+int main()
+{
+    BlastParserEnvironment environment;
+    std::string xml = blast_xml(4, 3);
+    // from just inside the root element to just before its end tag is
+    // complete
+    size_t first = xml.find("<BlastOutput_iterations>");
+    size_t last = xml.rfind("</BlastOutput>") + std::string("</BlastOutput>").size();
+    int cuts = 0;
+
+    if (parse_fails(xml)) {
+        cerr << "parseBlast: the complete document fails" << endl;
+        ++failures;
+    }
+    for (size_t length = first; length < last; length += 97) {
+        if (!parse_fails(xml.substr(0, length))) {
+            cerr << "parseBlast: no error for the first " << length << " bytes" << endl;
+            ++failures;
+        }
+        ++cuts;
+    }
+    if (!parse_fails(xml.substr(0, last - 1))) {
+        cerr << "parseBlast: no error without the last '>'" << endl;
+        ++failures;
+    }
+    // the pull reader stops with an error where parseBlast does
+    if (pull_queries(xml) != 3) {
+        cerr << "BlastQueryReader: the complete document fails" << endl;
+        ++failures;
+    }
+    for (size_t length = first; length < last; length += 997) {
+        if (pull_queries(xml.substr(0, length)) != -1) {
+            cerr << "BlastQueryReader: no error for the first " << length << " bytes" << endl;
+            ++failures;
+        }
+    }
+    // through the read-ahead thread
+    if (parse_fails(xml, true) || !parse_fails(xml.substr(0, xml.size() / 2), true)) {
+        cerr << "parseBlast: a file is not parsed like a stream" << endl;
+        ++failures;
+    }
+
+    cout << "truncated input: " << cuts << " cuts, " << failures << " failures" << endl;
+    return failures == 0 ? 0 : 1;
+}